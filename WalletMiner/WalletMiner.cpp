@@ -9,7 +9,9 @@
 #include <algorithm>
 #include <thread>
 #include <secp256k1.h>
+#include <secp256k1_extrakeys.h>
 #include <openssl/sha.h>
+#include <openssl/rand.h>
 #include <cassert>
 #include <chrono>
 #include <array>
@@ -18,41 +20,231 @@
 #include <memory>
 #include <filesystem>
 #include <unordered_map>
+#include <list>
+#include <map>
+#include <csignal>
+#include <cmath>
+#include <cctype>
+#include <mutex>
+#include <set>
+#include <variant>
+#include <bit>
 #include "ripemd160.c"
 #include "base58.h"
+#include "pipeline.h"
+#include "u256.h"
+#include "range.h"
+#include "checkpoint.h"
+#include "net.h"
+#include "ledger.h"
+#include "mpsc.h"
+#include "hitlog.h"
+#include "vanity.h"
+#include "bech32.h"
+#include "sha256.h"
+#include "network.h"
+#include "affinity.h"
+#include "stages.h"
+#include "perf.h"
+#include "statspage.h"
+#include "metrics.h"
 
 #pragma warning(disable : 4996) //_CRT_SECURE_NO_WARNINGS
 
 using namespace std::chrono;
 
-static constexpr size_t writeEveryXKeys = 1'000'000;
-static std::atomic<size_t> done;
-static std::atomic<size_t> doneStats;
+// Address formats derived from every key, --formats
+enum FormatFlags : unsigned {
+	FormatP2PKH = 1 << 0, // 1... of the compressed pubkey
+	FormatP2WPKH = 1 << 1, // bc1q...
+	FormatP2SHP2WPKH = 1 << 2, // 3... wrapping a P2WPKH script
+	FormatP2PKHUncompressed = 1 << 3, // 1... of the 65 bytes pubkey, legacy wallets
+	FormatP2TR = 1 << 4, // bc1p... key path output of the key, BIP86 wallets
+};
 
-// Struct to be able to make a hash out of pub addr
-// Uses FNV-1a
-// Stats showed (bucket filling): Min=0 Max=10 Avg=0.852572
-struct AddressHash {
-	std::size_t operator()(std::array<uint8_t, 36> const& a) const noexcept {
-		std::size_t h = 14695981039346656037ull;
-		for (uint8_t c : a) {
-			if (c == '\0') break;
-			h ^= c;
-			h *= 1099511628211ull;
-		}
-		return h;
+// Command line configuration
+struct Options {
+	// Miner: standalone, Coordinator: owns a range and leases it, Worker: scans leases of a coordinator
+	enum class Mode { Miner, Coordinator, Worker };
+	Mode mode = Mode::Miner;
+
+	std::vector<std::pair<Network, std::string>> balanceFiles; // [network:]file arguments, Bitcoin without prefix
+	unsigned formats = FormatP2PKH | FormatP2WPKH | FormatP2SHP2WPKH;
+	unsigned threads = std::thread::hardware_concurrency(); // Concurrent threads
+	unsigned batchKeys = 256; // Keys per batch, up to batchSize
+	unsigned lanes = 8; // Width of the hash160 lane kernels, 4, 8 or 16
+	bool autotune = false; // Pick threads, batchKeys and lanes by trials, or from the host profile
+	bool retune = false; // Run the trials even if the profile has this host
+	bool perf = false; // Hardware counters of the workers
+	std::string metrics; // Address of the Prometheus /metrics listener, none by default
+
+	// Deterministic scan of [start, end] instead of random keys
+	bool rangeScan = false;
+	bool interleave = false;
+	u256 start{};
+	u256 end{};
+
+	// Range scan progress file and how often it is rewritten
+	std::string checkpointFile = std::filesystem::current_path().string() + "/walletminer.checkpoint.txt";
+	unsigned checkpointInterval = 10;
+
+	// Distributed range scans
+	std::string listen; // Coordinator address
+	std::string connect; // Worker: coordinator to connect to
+	unsigned leaseSeconds = 60; // Lease size, in seconds of the worker's throughput
+	unsigned leaseTimeout = 180; // A lease not renewed within this delay is issued again
+
+	// Vanity search: P2PKH prefixes to find instead of funded addresses
+	std::vector<std::string> vanity;
+	bool ignoreCase = false; // Also match every upper / lower case spelling of the prefixes
+	bool keepGoing = false; // Keep searching once every prefix has been found
+	// Split key search: customer public key Q, keys are Q + tG and only the tweak t is reported
+	std::optional<secp256k1_pubkey> splitKey;
+
+	// End to end benchmark: runs the pipeline for benchSeconds and prints JSON, on a synthetic index without balance file
+	bool bench = false;
+	double benchSeconds = 10;
+	size_t benchIndex = 1'000'000; // Outputs of the synthetic index
+	std::string jsonFile; // Also write the benchmark JSON there
+	bool scaling = false; // Bench every thread count from 1 to all logical CPUs
+	std::vector<unsigned> cpus; // Bench: logical CPUs the workers are pinned to, worker i on cpus[i]
+};
+
+static std::atomic<unsigned> runningWorkers;
+static VanityPatterns vanityPatterns; // Built once before the threads start
+static std::atomic<uint64_t> testedKeys; // Never reset
+
+static StatsPage statsPage; // Header and worker slots of this process, read by wm-top
+static WorkerStats* workerStats; // Slots of statsPage, one per thread of the current run
+
+StatsTotals sumWorkerStats(unsigned threads) {
+	StatsTotals t;
+	for (unsigned i = 0; workerStats && i < threads; i++) t += workerStats[i].read();
+	return t;
+}
+
+// What the page shows wm-top the process is doing
+std::string runMode(Options const& opts) {
+	std::string mode = opts.mode == Options::Mode::Worker ? "worker" : opts.rangeScan ? "range" : !opts.vanity.empty() ? "vanity" : "random";
+	return opts.bench || opts.scaling ? "bench " + mode : mode;
+}
+
+void createStatsPage(Options const& opts) {
+	auto error = statsPage.create(std::max(opts.threads, std::thread::hardware_concurrency()), runMode(opts));
+	if (!error.empty()) std::cout << "Stats not shared, wm-top will not see this process: " << error << std::endl;
+}
+
+// Zeroes one slot per worker of the next run, before they start, the page is made on first use
+void resetWorkerStats(Options const& opts) {
+	if (statsPage.capacity() < opts.threads) {
+		uint64_t outputs = statsPage.capacity() ? statsPage.header()->indexOutputs.load() : 0;
+		createStatsPage(opts);
+		statsPage.header()->indexOutputs = outputs;
+		statsPage.header()->vanityProbability = vanityPatterns.empty() ? 0 : vanityPatterns.probability();
+	}
+	workerStats = statsPage.slots();
+	for (unsigned i = 0; i < opts.threads; i++) workerStats[i].reset();
+	statsPage.header()->threads = opts.threads;
+	statsPage.header()->state = static_cast<uint32_t>(MinerState::Running);
+}
+
+static std::atomic<bool> hwWarned;
+
+// Hardware counters per key, "ipc 1.52 llc_misses 0.8/key ...", empty without them
+std::string hwBreakdown(StatsTotals const& t) {
+	if (!t.hwMask || !t.keys) return {};
+	std::ostringstream os;
+	os << std::fixed << std::setprecision(2);
+	if ((t.hwMask & (1u << HwInstructions)) && t.hw[HwCycles]) os << "ipc " << double(t.hw[HwInstructions]) / t.hw[HwCycles];
+	for (unsigned c : { HwLlcMisses, HwDtlbMisses, HwBranchMisses }) {
+		if (t.hwMask & (1u << c)) os << " " << hwNames[c] << " " << double(t.hw[c]) / t.keys << "/key";
+	}
+	return os.str();
+}
+
+// Share of each stage in the time of the batches, "ec 80% sha256 9% ..."
+std::string stageBreakdown(StatsTotals const& t) {
+	uint64_t total = t.batchTicks();
+	std::string r;
+	for (unsigned s = 0; s < stageCount; s++) {
+		r += (s ? " " : "") + std::string{ stageNames[s] } + " " + std::to_string(total ? 100 * t.ticks[s] / total : 0) + "%";
+	}
+	if (t.taprootTicks) r += " (p2tr " + std::to_string(100 * t.taprootTicks / total) + "%)";
+	return r;
+}
+
+// Set by SIGINT / SIGTERM, workers stop after their current batch
+static std::atomic<bool> stopRequested;
+
+extern "C" void onStopSignal(int) {
+	stopRequested = true;
+}
+
+// Output types the balance dump is indexed by
+enum class AddressType : uint8_t { P2PKH, P2SH, P2WPKH };
+
+// Index key: the output type and the 20 bytes its script commits to
+struct TypedHash160 {
+	AddressType type;
+	std::array<uint8_t, 20> hash;
+
+	bool operator==(TypedHash160 const&) const = default;
+};
+
+// Hash160 values are uniformly distributed, their first bytes already make a good hash
+struct TypedHash160Hash {
+	std::size_t operator()(TypedHash160 const& a) const noexcept {
+		uint64_t h;
+		std::memcpy(&h, a.hash.data(), sizeof(h));
+		return static_cast<std::size_t>(h ^ static_cast<uint64_t>(a.type));
 	}
 };
 
-// Struct that accepts the comparison between 2 addr
-struct AddressEq {
-	bool operator()(std::array<uint8_t, 36> const& a, std::array<uint8_t, 36> const& b) const noexcept {
-		return std::strcmp(reinterpret_cast<const char*>(a.data()), reinterpret_cast<const char*>(b.data())) == 0;
+// Balance of an output on one chain
+// An output funded on several chains (the same hash160 is the same key everywhere) has its other entries linked in fundedMore
+struct Funded {
+	uint64_t balance;
+	Network network;
+	uint32_t next = 0; // 1 + index of the next entry in fundedMore, 0 for the last one
+};
+static std::vector<Funded> fundedMore;
+
+// Calls fn on the entry of every chain funding an output
+template<typename Fn>
+void forEachChain(Funded const& f, Fn&& fn) {
+	for (Funded const* e = &f; e; e = e->next ? &fundedMore[e->next - 1] : nullptr) {
+		fn(*e);
+	}
+}
+
+// The hash map containing every funded address, by type and hash160
+static std::unordered_map<TypedHash160, Funded, TypedHash160Hash> addresses;
+
+// Taproot outputs commit to a 32 bytes x-only key instead of a hash160
+using XOnlyKey = std::array<uint8_t, 32>;
+
+struct XOnlyKeyHash {
+	std::size_t operator()(XOnlyKey const& a) const noexcept {
+		uint64_t h;
+		std::memcpy(&h, a.data(), sizeof(h));
+		return static_cast<std::size_t>(h);
 	}
 };
 
-// The hash map containing all the pub addresses in base58
-static std::unordered_map<std::array<uint8_t, 36>, uint64_t, AddressHash, AddressEq> addresses;
+// Funded P2TR (bc1p...) outputs by x-only output key
+static std::unordered_map<XOnlyKey, Funded, XOnlyKeyHash> taprootKeys;
+
+// Memory held by the index: nodes (next pointer, cached hash, entry) and bucket arrays, plus the other chains' entries
+uint64_t indexMemory() {
+	auto map = [](auto const& m) {
+		using Entry = typename std::decay_t<decltype(m)>::value_type;
+		return m.size() * (sizeof(void*) + sizeof(size_t) + sizeof(Entry)) + m.bucket_count() * sizeof(void*);
+	};
+	return map(addresses) + map(taprootKeys) + fundedMore.capacity() * sizeof(Funded);
+}
+
+// What an address of the dump is looked up by
+using IndexKey = std::variant<TypedHash160, XOnlyKey>;
 
 // Used to check if the hash does its job (debug purposes)
 void testDistribution() {
@@ -80,60 +272,6 @@ const std::array<uint8_t, 32> SECP256K1_N = {
 };
 
 
-// Load all addresses from a file with their balance into an hash map
-// Format is P2PKH
-// Will only load keys starting with 1 or 3
-// Other keys such as bc1...., s-..... will be ignored
-void loadValidAddresses(const char* path){
-	std::cout << "Loading keys..." << std::endl;
-	std::ifstream f{ path };
-	if (f.fail()) {
-		throw std::runtime_error{ "Error opening addresses file." };
-	}
-	std::string line;
-	while(std::getline(f, line)){
-		if (line.empty()) continue;
-		auto pos = line.find_first_of('\t');
-		if (pos == std::string::npos) continue;
-
-		std::string address = line.substr(0, pos);
-		uint64_t balance;
-		try {
-			balance = std::stoull(line.substr(pos + 1));
-		}
-		catch (...) {
-			continue;
-		}
-
-		if (!(address.starts_with("1") || address.starts_with("3"))) {
-			continue;
-		}
-
-		try {
-			std::array<uint8_t, 36> key{0};
-			std::strncpy(reinterpret_cast<char*>(key.data()), address.c_str(), 35);
-			key.back() = '\0';
-			addresses.emplace(key, balance);
-		}
-		catch (...) {
-			// We got an invalid base58 addr in the file
-			continue;
-		}
-	}
-	std::cout << "Loaded " << addresses.size() << " addresses from file" << std::endl;
-}
-
-
-// check if addr is in addresses
-inline std::optional<uint64_t> checkAddr(std::array<uint8_t, 36> const& addr){
-
-	auto it = addresses.find(addr);
-	if(it != addresses.end()){
-		return it->second;
-	}
-	return std::nullopt;
-}
-
 // Applies sha256 on a raw array and returns an std::array of size 32
 inline std::array<uint8_t, 32> sha256(const uint8_t* data, size_t len) {
 	std::array<uint8_t, 32> sha256r;
@@ -141,28 +279,26 @@ inline std::array<uint8_t, 32> sha256(const uint8_t* data, size_t len) {
 	return sha256r;
 }
 
-// Return a public key in the compressed form
-// Key is base58 encoded and in the form of a 36 byte null terminated array
-std::array<uint8_t, 36> privateKeyToAddress(std::array<uint8_t, 32> const& prvkey, secp256k1_context* ctx) {
-	secp256k1_pubkey pubkey;
-
-	if (secp256k1_ec_pubkey_create(ctx, &pubkey, prvkey.data()) == 0) {
-		throw std::runtime_error{ "Cannot make pubkey" };
-	}
-	
-	// Serialize pub key in compressed form
-	uint8_t serializedpubKey[33];
-	size_t ss = 33;
-	secp256k1_ec_pubkey_serialize(ctx, serializedpubKey, &ss, &pubkey, SECP256K1_EC_COMPRESSED);
+// Hash160 of a public key in the compressed form, or uncompressed with SECP256K1_EC_UNCOMPRESSED
+// ripemd160(sha256(pubkey))
+inline std::array<uint8_t, 20> pubkeyToHash160(secp256k1_pubkey const& pubkey, secp256k1_context* ctx, unsigned int flags = SECP256K1_EC_COMPRESSED) {
+	// Serialize pub key in the requested form
+	uint8_t serializedpubKey[65];
+	size_t ss = sizeof(serializedpubKey);
+	secp256k1_ec_pubkey_serialize(ctx, serializedpubKey, &ss, &pubkey, flags);
 
-	// 0x00 + ripemd160 of sha256res
 	auto sha = sha256(serializedpubKey, ss);
-	uint8_t ripemd160r[21] = { 0 };
-	ripemd160(sha.data(), sha.size(), ripemd160r + 1);
+	std::array<uint8_t, 20> hash160;
+	ripemd160(sha.data(), static_cast<uint32_t>(sha.size()), hash160.data());
+	return hash160;
+}
 
-	// Copy ripemd160 in final container
-	std::array<uint8_t, 25> hashPubKey{};
-	std::copy_n(ripemd160r, 21, hashPubKey.begin());
+// Hash160 to P2PKH address, or P2SH with version 0x05
+// Key is base58 encoded and in the form of a 36 byte null terminated array
+std::array<uint8_t, 36> hash160ToAddress(std::array<uint8_t, 20> const& hash160, uint8_t version = 0x00) {
+	// version + ripemd160 of sha256res
+	std::array<uint8_t, 25> hashPubKey{ version };
+	std::copy_n(hash160.begin(), 20, hashPubKey.begin() + 1);
 
 	// 2 times checksum
 	auto checksum = sha256(hashPubKey.data(), 21);
@@ -175,6 +311,18 @@ std::array<uint8_t, 36> privateKeyToAddress(std::array<uint8_t, 32> const& prvke
 	return base58Encode(hashPubKey, base58map);
 }
 
+// Return a public key in the compressed form
+// Key is base58 encoded and in the form of a 36 byte null terminated array
+std::array<uint8_t, 36> privateKeyToAddress(std::array<uint8_t, 32> const& prvkey, secp256k1_context* ctx) {
+	secp256k1_pubkey pubkey;
+
+	if (secp256k1_ec_pubkey_create(ctx, &pubkey, prvkey.data()) == 0) {
+		throw std::runtime_error{ "Cannot make pubkey" };
+	}
+
+	return hash160ToAddress(pubkeyToHash160(pubkey, ctx));
+}
+
 
 // 64 chars hex string to 32 bytes private key
 std::array<uint8_t, 32> stringToPrvKey(std::string const& str) {
@@ -233,18 +381,25 @@ std::array<uint8_t, 32> generateRandomPrvKey(bool trueGenerator = false) {
 
 }
 
-auto getElapsedTime(time_point<system_clock, milliseconds> lastUpdate) {
-	time_point<system_clock, milliseconds> now = time_point_cast<milliseconds>(system_clock::now());
-	auto delay = duration_cast<milliseconds>(now - lastUpdate);
-	auto delay_ms = delay.count();
-	return delay_ms;
+// Private key from the OpenSSL CSPRNG, for keys that are handed out
+std::array<uint8_t, 32> secureRandomPrvKey() {
+	std::array<uint8_t, 32> key{};
+	do {
+		if (RAND_bytes(key.data(), static_cast<int>(key.size())) != 1) {
+			throw std::runtime_error{ "RAND_bytes failed" };
+		}
+	} while (!checkValidPrvKey(key) || key == std::array<uint8_t, 32>{});
+	return key;
 }
 
-template<typename T, typename U>
-double getSpeed(T elapsedTime, U processedNumber) {
-	double ratio = elapsedTime / 1000.0;
-	if (ratio == 0) return 0.0;
-	return processedNumber / ratio;
+// Short human readable duration, 3d4h, 5h12m, 7m30s, 42s
+std::string formatDuration(double secs) {
+	if (!std::isfinite(secs) || secs > 1e12) return "forever";
+	uint64_t s = static_cast<uint64_t>(secs);
+	if (s >= 86400) return std::to_string(s / 86400) + "d" + std::to_string(s % 86400 / 3600) + "h";
+	if (s >= 3600) return std::to_string(s / 3600) + "h" + std::to_string(s % 3600 / 60) + "m";
+	if (s >= 60) return std::to_string(s / 60) + "m" + std::to_string(s % 60) + "s";
+	return std::to_string(s) + "s";
 }
 
 std::array<uint8_t, 36> strToArr(std::string const& addr) {
@@ -257,133 +412,2392 @@ std::string arrToStr(std::array<uint8_t, 36> const& addr) {
 	return std::string(reinterpret_cast<const char*>(addr.data()));
 }
 
+// Hash160 of the P2SH-P2WPKH redeem script of a compressed pubkey hash160
+// ripemd160(sha256(OP_0 PUSH20 hash160))
+inline std::array<uint8_t, 20> nestedScriptHash160(std::array<uint8_t, 20> const& hash160) {
+	uint8_t script[22] = { 0x00, 0x14 };
+	std::copy(hash160.begin(), hash160.end(), script + 2);
+	auto sha = sha256(script, sizeof(script));
+	std::array<uint8_t, 20> r;
+	ripemd160(sha.data(), static_cast<uint32_t>(sha.size()), r.data());
+	return r;
+}
 
-void check() {
-	secp256k1_context* ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
-	while (true) {
-		auto prv = generateRandomPrvKey(true); // Gen a valid rnd prv key
-		auto pub = privateKeyToAddress(prv, ctx); // Extract the pub
-		auto res = checkAddr(pub); // Check if pub is found in the addr directory
-		done++;
-		doneStats++;
-		if (res) {
-			// Really unlikely to happen, no need to sync =D
-			std::cout << "-------------------- NON NULL BALANCE FOUND --------------------" << std::endl;
-			std::ofstream os{ std::filesystem::current_path().string() + "/walletminer.balance." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".txt", std::ofstream::app};
-			std::string addrBal{ prvKeyToString(prv) + " => [" + arrToStr(pub) + "]" + ", BALANCE: " + std::to_string(*res) + "sat\n"};
-			os.write(addrBal.c_str(), addrBal.size());
-			os.close();
+// Text form of an index key on a chain, segwit types only exist on chains with an hrp
+std::string encodeAddress(TypedHash160 const& key, Network network = Network::Bitcoin) {
+	auto const& params = networkParams(network);
+	switch (key.type) {
+	case AddressType::P2PKH: return arrToStr(hash160ToAddress(key.hash, params.p2pkh));
+	case AddressType::P2SH: return arrToStr(hash160ToAddress(key.hash, params.p2sh));
+	case AddressType::P2WPKH: return segwitAddress(params.hrp, 0, key.hash.data(), key.hash.size());
+	}
+	return {};
+}
+
+std::string encodeAddress(XOnlyKey const& key, Network network = Network::Bitcoin) {
+	return segwitAddress(networkParams(network).hrp, 1, key.data(), key.size());
+}
+
+// Index key of an address of the given chain, nullopt for unsupported or invalid ones (bad checksum included)
+std::optional<IndexKey> decodeAddress(std::string_view address, Network network = Network::Bitcoin) {
+	auto const& params = networkParams(network);
+	TypedHash160 key{};
+	std::string_view hrp = params.hrp ? params.hrp : "";
+	bool segwit = !hrp.empty() && address.size() > hrp.size() && address[hrp.size()] == '1'
+		&& std::equal(hrp.begin(), hrp.end(), address.begin(), [](char a, char b) { return a == std::tolower(static_cast<unsigned char>(b)); });
+	if (!segwit) {
+		if (address.size() < 25 || address.size() > 35) return std::nullopt; // 25 bytes in base58
+		std::array<uint8_t, 25> raw;
+		try {
+			raw = base58Decode(std::string{ address });
 		}
+		catch (...) {
+			return std::nullopt;
+		}
+		auto checksum = sha256(raw.data(), 21);
+		checksum = sha256(checksum.data(), checksum.size());
+		if (!std::equal(raw.begin() + 21, raw.end(), checksum.begin())) return std::nullopt;
+		if (raw[0] == params.p2pkh) key.type = AddressType::P2PKH;
+		else if (raw[0] == params.p2sh || raw[0] == params.p2shLegacy) key.type = AddressType::P2SH;
+		else return std::nullopt;
+		std::copy_n(raw.begin() + 1, 20, key.hash.begin());
+		return key;
 	}
-	secp256k1_context_destroy(ctx);
+	auto program = segwitDecode(hrp, address);
+	if (program && program->version == 0 && program->size == 20) {
+		key.type = AddressType::P2WPKH;
+		std::copy_n(program->program.begin(), 20, key.hash.begin());
+		return key;
+	}
+	if (program && program->version == 1 && program->size == 32) {
+		XOnlyKey x;
+		std::copy_n(program->program.begin(), 32, x.begin());
+		return x;
+	}
+	return std::nullopt;
 }
 
-void writeStats() {
-	if(doneStats > writeEveryXKeys){
-		std::string end = " tested keys";
-		std::string filename = std::filesystem::current_path().string() + "/walletminer.stats.txt";
-		std::fstream statsFile{ filename, std::fstream::in | std::fstream::out};
-		if (statsFile.fail()) {
-			return;
+// Decodes one "address<TAB>balance" row of the dump
+std::optional<std::pair<IndexKey, uint64_t>> parseBalanceLine(std::string const& line, Network network) {
+	auto pos = line.find_first_of('\t');
+	if (pos == std::string::npos) return std::nullopt;
+
+	uint64_t balance;
+	try {
+		balance = std::stoull(line.substr(pos + 1));
+	}
+	catch (...) {
+		return std::nullopt;
+	}
+
+	auto key = decodeAddress(std::string_view{ line }.substr(0, pos), network);
+	if (!key) {
+		// Unsupported type or invalid addr in the file
+		return std::nullopt;
+	}
+	return std::make_pair(*key, balance);
+}
+
+// Adds the balance of an output on a chain, the first row wins when a chain lists the output twice
+template<typename Map, typename Key>
+void addFunded(Map& map, Key const& key, Network network, uint64_t balance) {
+	auto [it, inserted] = map.try_emplace(key, Funded{ balance, network });
+	if (inserted) return;
+	Funded* last = &it->second;
+	while (true) {
+		if (last->network == network) return;
+		if (!last->next) break;
+		last = &fundedMore[last->next - 1];
+	}
+	last->next = static_cast<uint32_t>(fundedMore.size() + 1); // Before the push, last may point into fundedMore
+	fundedMore.push_back({ balance, network });
+}
+
+// Load all addresses of a chain from a file with their balance into hash maps
+// Keeps P2PKH (1...), P2SH (3...) and P2WPKH (bc1q...) addresses by type and hash160, P2TR (bc1p...) by x-only key
+// Other keys such as bc1q P2WSH, s-..... will be ignored
+// Rows are read by blocks whose checksums are verified by all threads, the maps are filled in file order
+void loadValidAddresses(const char* path, Network network, unsigned threads){
+	std::cout << "Loading " << networkParams(network).name << " keys..." << std::endl;
+	auto* page = statsPage.header(); // Progress for wm-top and /metrics
+	std::ifstream f{ path };
+	if (f.fail()) {
+		throw std::runtime_error{ "Error opening addresses file." };
+	}
+	threads = std::max(threads, 1u);
+	static constexpr size_t blockLines = 1 << 16;
+	std::vector<std::string> lines;
+	lines.reserve(blockLines);
+	std::vector<std::vector<std::pair<IndexKey, uint64_t>>> decoded(threads);
+
+	auto flush = [&]() {
+		std::vector<std::thread> pool;
+		for (unsigned t = 0; t < threads; t++) {
+			pool.emplace_back([&, t]() {
+				decoded[t].clear();
+				for (size_t i = lines.size() * t / threads; i < lines.size() * (t + 1) / threads; i++) {
+					if (auto row = parseBalanceLine(lines[i], network)) decoded[t].push_back(std::move(*row));
+				}
+			});
+		}
+		for (auto& th : pool) th.join();
+		for (auto& rows : decoded) {
+			for (auto& [key, balance] : rows) {
+				if (auto h = std::get_if<TypedHash160>(&key)) addFunded(addresses, *h, network, balance);
+				else addFunded(taprootKeys, std::get<XOnlyKey>(key), network, balance);
+			}
 		}
+		lines.clear();
+	};
 
-		std::string line;
-		std::getline(statsFile, line);
-		statsFile.clear(); // Clear failbit
+	size_t rows = 0;
+	uint64_t bytes = 0; // Read since the last progress update
+	std::string line;
+	while(std::getline(f, line)){
+		bytes += line.size() + 1;
+		if (line.empty()) continue;
+		lines.push_back(std::move(line));
+		if (lines.size() == blockLines) {
+			rows += lines.size();
+			flush();
+			if (page) {
+				page->loaderBytes += bytes;
+				page->loaderRows += blockLines;
+			}
+			bytes = 0;
+		}
+	}
+	rows += lines.size();
+	if (page) page->loaderRows += lines.size();
+	flush();
+	if (page) page->loaderBytes += bytes;
+	std::cout << "Read " << rows << " rows, index holds " << addresses.size() + taprootKeys.size() << " outputs (" << taprootKeys.size() << " taproot, " << fundedMore.size() << " also funded on another chain)" << std::endl;
+}
 
-		const char* digits = "0123456789";
-		std::size_t firstPos = line.find_first_of(digits);
-		if (firstPos != std::string::npos) {
-			std::size_t lastPos = line.find_first_not_of(digits);
-			doneStats += std::atoi(line.substr(firstPos, lastPos - firstPos).c_str());
+// Benchmark index of random outputs, spread over the P2PKH, P2SH, P2WPKH and P2TR maps
+// Seeded so runs of different builds probe the same tables
+void loadSyntheticIndex(size_t size) {
+	std::cout << "Building a synthetic index of " << size << " outputs..." << std::endl;
+	std::mt19937_64 rng{ 42 };
+	auto fill = [&rng](auto& bytes) {
+		for (size_t i = 0; i < bytes.size(); i += 8) {
+			uint64_t v = rng();
+			std::memcpy(bytes.data() + i, &v, std::min<size_t>(8, bytes.size() - i));
+		}
+	};
+	addresses.reserve(addresses.size() + size - size / 4);
+	taprootKeys.reserve(taprootKeys.size() + size / 4);
+	for (size_t i = 0; i < size; i++) {
+		uint64_t balance = 546 + rng() % 100'000'000;
+		if (i % 4 == 3) {
+			XOnlyKey x;
+			fill(x);
+			addFunded(taprootKeys, x, Network::Bitcoin, balance);
 		}
+		else {
+			TypedHash160 key{ static_cast<AddressType>(i % 4), {} };
+			fill(key.hash);
+			addFunded(addresses, key, Network::Bitcoin, balance);
+		}
+	}
+}
 
-		statsFile.seekg(0, std::ios::beg);
-		statsFile << (std::to_string(doneStats) + end);
+// Balances of an index key on every chain, nullptr if funded nowhere
+// One probe covers all the loaded chains
+inline Funded const* checkHash160(TypedHash160 const& key) {
+	auto it = addresses.find(key);
+	if (it != addresses.end()) {
+		return &it->second;
+	}
+	return nullptr;
+}
 
-		statsFile.close();
-		doneStats = 0;
+// Balances of a taproot output key on every chain, nullptr if funded nowhere
+inline Funded const* checkXOnly(XOnlyKey const& key) {
+	auto it = taprootKeys.find(key);
+	if (it != taprootKeys.end()) {
+		return &it->second;
 	}
+	return nullptr;
 }
 
-int main(int argc, char** argv) {
+// Balance of an address of a chain in any supported format, if funded
+std::optional<uint64_t> checkAddress(std::string const& address, Network network = Network::Bitcoin) {
+	auto key = decodeAddress(address, network);
+	if (!key) return std::nullopt;
+	auto h = std::get_if<TypedHash160>(&*key);
+	Funded const* funded = h ? checkHash160(*h) : checkXOnly(std::get<XOnlyKey>(*key));
+	std::optional<uint64_t> r;
+	if (funded) {
+		forEachChain(*funded, [&](Funded const& f) {
+			if (f.network == network) r = f.balance;
+		});
+	}
+	return r;
+}
 
-	if (argc < 2) {
-		std::cout << "Usage WalletMiner.exe <balance_file>" << std::endl;
-		return 1;
+// BIP86 key path output key: Q = P + H_TapTweak(x(P)) G, P being the pubkey with an even y
+// Reference version, the workers hash in batches
+std::optional<XOnlyKey> taprootOutputKey(secp256k1_pubkey const& pubkey, secp256k1_context* ctx) {
+	secp256k1_xonly_pubkey internal;
+	XOnlyKey x;
+	uint8_t tweak[32];
+	secp256k1_pubkey output;
+	size_t len = 33;
+	uint8_t serialized[33];
+	if (!secp256k1_xonly_pubkey_from_pubkey(ctx, &internal, nullptr, &pubkey)
+		|| !secp256k1_xonly_pubkey_serialize(ctx, x.data(), &internal)
+		|| !secp256k1_tagged_sha256(ctx, tweak, reinterpret_cast<const unsigned char*>("TapTweak"), 8, x.data(), x.size())
+		|| !secp256k1_xonly_pubkey_tweak_add(ctx, &output, &internal, tweak)) {
+		return std::nullopt;
 	}
+	secp256k1_ec_pubkey_serialize(ctx, serialized, &len, &output, SECP256K1_EC_COMPRESSED);
+	std::copy_n(serialized + 1, 32, x.begin());
+	return x;
+}
 
-	// Check that the built address is right for the private key
-	secp256k1_context* ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+// Every address a pubkey pays to on a chain in the supported formats, the reference derivation used to check hits
+std::vector<std::string> derivedAddresses(secp256k1_pubkey const& pubkey, secp256k1_context* ctx, Network network = Network::Bitcoin) {
+	auto hash160 = pubkeyToHash160(pubkey, ctx);
+	std::vector<std::string> r{
+		encodeAddress({ AddressType::P2PKH, hash160 }, network),
+		encodeAddress({ AddressType::P2SH, nestedScriptHash160(hash160) }, network),
+		encodeAddress({ AddressType::P2PKH, pubkeyToHash160(pubkey, ctx, SECP256K1_EC_UNCOMPRESSED) }, network),
+	};
+	if (networkParams(network).hrp) {
+		r.push_back(encodeAddress({ AddressType::P2WPKH, hash160 }, network));
+		if (auto x = taprootOutputKey(pubkey, ctx)) r.push_back(encodeAddress(*x, network));
+	}
+	return r;
+}
 
-	// Check that prv => pub function gives the right pub key
-	assert(
-		privateKeyToAddress(
-			stringToPrvKey("be63955589062b68320f0a3d5b450551c67bbb5f6e5b34cec57738f3a96316a9"), ctx)
-		== strToArr("1Dai8FBumerEYMzijW7hfMgD45HowqYzVP")
-	);
 
-	// Check that a valid prv key is considered valid by the system
-	assert(
-		checkValidPrvKey(stringToPrvKey("be63955589062b68320f0a3d5b450551c67bbb5f6e5b34cec57738f3a96316a9"))
-	);
+// Keys processed together by every stage of the pipeline
+static constexpr size_t batchSize = 256; // Capacity, a batch holds Options::batchKeys keys
 
+struct Batch {
+	std::array<std::array<uint8_t, 32>, batchSize> prv;
+	std::array<secp256k1_pubkey, batchSize> pub;
+	std::array<std::array<uint8_t, 20>, batchSize> hash160;
+	std::array<std::array<uint8_t, 20>, batchSize> scriptHash160; // P2SH-P2WPKH
+	std::array<std::array<uint8_t, 20>, batchSize> uncompressedHash160; // P2PKH of the 65 bytes pubkey
+	std::array<XOnlyKey, batchSize> taprootKey; // P2TR output key
+};
 
-	// Check that conversions work
-	assert(arrToStr(strToArr("1LruNZjwamWJXThX2Y8C2d47QqhAkkc5os")) == "1LruNZjwamWJXThX2Y8C2d47QqhAkkc5os");
-	assert(
-		prvKeyToString(
-			stringToPrvKey("be63955589062b68320f0a3d5b450551c67bbb5f6e5b34cec57738f3a96316a9")
-		) == "be63955589062b68320f0a3d5b450551c67bbb5f6e5b34cec57738f3a96316a9"
-	);
+// Per thread state handed to the pipeline policies
+struct WorkerContext {
+	Options const& opts;
+	secp256k1_context* ctx;
+	unsigned id;
+	RangeJob* range;
+	WorkerStats& stats;
+	StageClock clock{}; // Laps of the current batch, published to stats once it is done
+	BatchCounts counts{}; // Matcher counts of the current batch, published with the laps
+	bool walk = false; // The key source walks from random starts, set when it is built
+	bool walkSpent = false; // A key of the current random walk was reported, the next batch starts a new walk
+};
 
-	secp256k1_context_destroy(ctx);
+// Key source: walks the segments of a range job
+// Each pubkey is the previous one plus stride * G instead of a full multiplication
+struct RangeKeySource {
+	static bool enabled(Options const& opts) { return opts.rangeScan; }
 
-	try {
-		loadValidAddresses(argv[1]);
-#ifndef NDEBUG
-		testDistribution();
-#endif // DEBUG
+	explicit RangeKeySource(WorkerContext& wc) : ctx{ wc.ctx }, id{ wc.id }, job{ *wc.range }, limit{ wc.opts.batchKeys }, clock{ wc.clock } {}
+
+	~RangeKeySource() {
+		// The last batch has been tested unless we are unwinding
+		if (std::uncaught_exceptions() == 0) {
+			job.commit(id, active ? &seg : nullptr);
+		}
+	}
 
+	size_t fill(Batch& b) {
+		// Everything handed out before has been tested, publish the position for checkpoints
+		job.commit(id, active ? &seg : nullptr);
+		clock.lap(StageKeys);
 
+		size_t n = 0;
+		while (n < limit) {
+			if (!active) {
+				// Never wait with a partial batch, its keys would stay in flight and keep the job busy
+				clock.lap(StageEC);
+				bool acquired = job.acquire(id, seg, n == 0);
+				clock.lap(StageKeys);
+				if (!acquired) break;
+				startSegment();
+			}
+
+			b.prv[n] = seg.next;
+			b.pub[n] = point;
+			n++;
+
+			if (u256Cmp(seg.next, seg.end) >= 0) {
+				active = false;
+				continue;
+			}
+			seg.next = u256AddU64(seg.next, seg.stride);
+			// combine clears its output first, it cannot be one of the inputs
+			const secp256k1_pubkey* ins[2] = { &b.pub[n - 1], &step };
+			if (secp256k1_ec_pubkey_combine(ctx, &point, ins, 2) == 0) {
+				throw std::runtime_error{ "Cannot step pubkey" };
+			}
+		}
+		clock.lap(StageEC);
+		return n;
 	}
-	catch (const std::exception& e) {
-		std::cout << "Error loading file" << std::endl;
-		std::cout << e.what() << std::endl;
-		return 2;
+
+	void startSegment() {
+		if (!checkValidPrvKey(seg.end) || u256IsZero(seg.next)) {
+			throw std::runtime_error{ "Segment out of the private key range" };
+		}
+		if (secp256k1_ec_pubkey_create(ctx, &point, seg.next.data()) == 0) {
+			throw std::runtime_error{ "Cannot make pubkey" };
+		}
+		if (seg.stride != stepStride) {
+			if (secp256k1_ec_pubkey_create(ctx, &step, u256FromU64(seg.stride).data()) == 0) {
+				throw std::runtime_error{ "Cannot make step pubkey" };
+			}
+			stepStride = seg.stride;
+		}
+		active = true;
 	}
 
-	// Using a random pub key in the file to see if it finds it in addresses
-	assert(checkAddr(strToArr("1LruNZjwamWJXThX2Y8C2d47QqhAkkc5os")).has_value());
-	
+	secp256k1_context* ctx;
+	unsigned id;
+	RangeJob& job;
+	size_t limit;
+	StageClock& clock;
+	Segment seg;
+	bool active = false;
+	secp256k1_pubkey point;
+	secp256k1_pubkey step;
+	uint32_t stepStride = 0;
+};
 
-	unsigned int _maxThreads = std::thread::hardware_concurrency(); // Concurrent threads
-	std::vector<std::thread> threads;
-	for (unsigned int i = 0; i < _maxThreads; i++) {
-		threads.emplace_back(
-			std::thread{ []() {
-				try {
-					check();
-				}
-				catch (const std::exception& e) {
-					std::cout << e.what() << std::endl;
-					exit(1);
-				}
-			}} 
-		);
+// Key source: a fresh random private key for every slot of the batch
+struct RandomKeySource {
+	static bool enabled(Options const&) { return true; }
+
+	explicit RandomKeySource(WorkerContext& wc) : ctx{ wc.ctx }, limit{ wc.opts.batchKeys }, clock{ wc.clock } {}
+
+	size_t fill(Batch& b) {
+		for (size_t i = 0; i < limit; i++) {
+			b.prv[i] = generateRandomPrvKey(true); // Gen a valid rnd prv key
+		}
+		clock.lap(StageKeys);
+		for (size_t i = 0; i < limit; i++) {
+			if (secp256k1_ec_pubkey_create(ctx, &b.pub[i], b.prv[i].data()) == 0) {
+				throw std::runtime_error{ "Cannot make pubkey" };
+			}
+		}
+		clock.lap(StageEC);
+		return limit;
 	}
 
+	secp256k1_context* ctx;
+	size_t limit;
+	StageClock& clock;
+};
 
-	time_point<system_clock, milliseconds> lastUpdate = time_point_cast<milliseconds>(system_clock::now());
-	while (true) {
-		std::this_thread::sleep_for(std::chrono::milliseconds(200));
-		auto elapsedTime = getElapsedTime(lastUpdate);
-		lastUpdate = time_point_cast<milliseconds>(system_clock::now());
-		auto speed = getSpeed(elapsedTime, done.load());
-		writeStats();
-		done = 0;
-		std::cout << "\r" << speed << " keys/s             " << std::flush;
+// Key source: consecutive keys from a random start, one point addition per key
+// For searches where any key will do, the start is drawn again every walkLength keys
+// With a split key the walk starts from Q + tG, the batch then holds the tweaks t instead of private keys
+struct RandomWalkKeySource {
+	static bool enabled(Options const& opts) { return !opts.vanity.empty(); }
+
+	static constexpr uint64_t walkLength = 1 << 20;
+
+	explicit RandomWalkKeySource(WorkerContext& wc) : ctx{ wc.ctx }, limit{ wc.opts.batchKeys }, clock{ wc.clock }, spent{ wc.walkSpent }, base{ wc.opts.splitKey } {
+		wc.walk = true;
+		if (secp256k1_ec_pubkey_create(ctx, &g, u256FromU64(1).data()) == 0) {
+			throw std::runtime_error{ "Cannot make generator pubkey" };
+		}
+	}
+
+	size_t fill(Batch& b) {
+		// Keys of a walk are its start plus a small offset, once one is reported the others are known too
+		if (spent) {
+			left = 0;
+			spent = false;
+		}
+		for (size_t i = 0; i < limit; i++) {
+			if (left == 0) restart();
+			b.prv[i] = prv;
+			b.pub[i] = point;
+			prv = u256AddU64(prv, 1);
+			left--;
+			// combine clears its output first, it cannot be one of the inputs
+			const secp256k1_pubkey* ins[2] = { &b.pub[i], &g };
+			if (left && secp256k1_ec_pubkey_combine(ctx, &point, ins, 2) == 0) {
+				throw std::runtime_error{ "Cannot step pubkey" };
+			}
+		}
+		clock.lap(StageEC);
+		return limit;
+	}
+
+	void restart() {
+		// The whole walk stays below the curve order
+		clock.lap(StageEC);
+		do {
+			prv = secureRandomPrvKey();
+		} while (!checkValidPrvKey(u256AddU64(prv, walkLength)));
+		clock.lap(StageKeys);
+		if (base) {
+			point = *base;
+			if (secp256k1_ec_pubkey_tweak_add(ctx, &point, prv.data()) == 0) {
+				throw std::runtime_error{ "Cannot tweak split key" };
+			}
+		}
+		else if (secp256k1_ec_pubkey_create(ctx, &point, prv.data()) == 0) {
+			throw std::runtime_error{ "Cannot make pubkey" };
+		}
+		left = walkLength;
+	}
+
+	secp256k1_context* ctx;
+	size_t limit;
+	StageClock& clock;
+	bool& spent;
+	std::optional<secp256k1_pubkey> base;
+	secp256k1_pubkey g;
+	secp256k1_pubkey point;
+	u256 prv{};
+	uint64_t left = 0;
+};
+
+// Pubkeys hashed together by the sha256 lane kernels, the hash160 of the derivers can also use 4 or 16 (Options::lanes)
+static constexpr size_t hashLanes = 8;
+static_assert(batchSize % 16 == 0);
+
+// sha256 then ripemd160 of n serialized pubkeys of Len bytes, lanes past n hash a copy of the last key
+// Every sha256 of a batch is done before its ripemd160s, so a clock can time them apart
+template<size_t Len, size_t Lanes = hashLanes>
+void hash160Lanes(uint8_t const (*keys)[Len], size_t n, std::array<uint8_t, 20>* out, StageClock* clock = nullptr) {
+	uint8_t sha[batchSize][32];
+	for (size_t first = 0; first < n; first += batchSize) {
+		size_t count = std::min(batchSize, n - first);
+		for (size_t i = 0; i < count; i += Lanes) {
+			const uint8_t* in[Lanes];
+			uint8_t* shaOut[Lanes];
+			for (size_t l = 0; l < Lanes; l++) {
+				in[l] = keys[first + std::min(i + l, count - 1)];
+				shaOut[l] = sha[i + l];
+			}
+			sha256k::sha256Lanes<Len, Lanes>(in, shaOut);
+		}
+		if (clock) clock->lap(StageSha256);
+		for (size_t i = 0; i < count; i++) {
+			ripemd160(sha[i], 32, out[first + i].data());
+		}
+		if (clock) clock->lap(StageRipemd160);
+	}
+}
+
+// Same with the lane width chosen at run time
+template<size_t Len>
+void hash160Lanes(uint8_t const (*keys)[Len], size_t n, std::array<uint8_t, 20>* out, unsigned lanes, StageClock* clock = nullptr) {
+	switch (lanes) {
+	case 4: hash160Lanes<Len, 4>(keys, n, out, clock); break;
+	case 16: hash160Lanes<Len, 16>(keys, n, out, clock); break;
+	default: hash160Lanes<Len, hashLanes>(keys, n, out, clock); break;
+	}
+}
+
+// P2SH-P2WPKH script hashes of up to batchSize hash160s, timed like hash160Lanes
+void nestedScriptHash160s(std::array<uint8_t, 20> const* hash160, size_t n, std::array<uint8_t, 20>* out, StageClock& clock) {
+	std::array<uint8_t, 32> sha[batchSize];
+	for (size_t i = 0; i < n; i++) {
+		uint8_t script[22] = { 0x00, 0x14 };
+		std::copy(hash160[i].begin(), hash160[i].end(), script + 2);
+		sha[i] = sha256(script, sizeof(script));
+	}
+	clock.lap(StageSha256);
+	for (size_t i = 0; i < n; i++) {
+		ripemd160(sha[i].data(), 32, out[i].data());
+	}
+	clock.lap(StageRipemd160);
+}
+
+// Optional stage of the derivers: P2TR output keys, --formats p2tr
+// The TapTweak hashes of a batch go through the sha256 lanes from the tag midstate,
+// then each key costs one tweak add (a multiplication of G) done by libsecp256k1,
+// by far the most expensive step of a key after its own derivation, its time is shown in the stats
+struct TaprootStage {
+	explicit TaprootStage(WorkerContext& wc) : ctx{ wc.ctx }, clock{ wc.clock }, enabled{ wc.opts.vanity.empty() && (wc.opts.formats & FormatP2TR) != 0 } {
+		auto tag = sha256(reinterpret_cast<const uint8_t*>("TapTweak"), 8);
+		sha256k::taggedMidstate(tag.data(), midstate);
+	}
+
+	// keys are the compressed pubkeys of the batch, their x is the internal key whatever the parity of y
+	void run(Batch& b, uint8_t const (*keys)[33], size_t n) {
+		uint64_t start = clock.last;
+		for (size_t i = 0; i < n; i += hashLanes) {
+			const uint8_t* in[hashLanes];
+			uint8_t* out[hashLanes];
+			for (size_t l = 0; l < hashLanes; l++) {
+				in[l] = keys[std::min(i + l, n - 1)] + 1;
+				out[l] = tweaks[i + l];
+			}
+			sha256k::taggedSha256Lanes<hashLanes>(midstate, in, out);
+		}
+		clock.lap(StageSha256);
+		for (size_t i = 0; i < n; i++) {
+			secp256k1_xonly_pubkey internal;
+			secp256k1_pubkey output;
+			uint8_t serialized[33];
+			size_t len = 33;
+			if (!secp256k1_xonly_pubkey_from_pubkey(ctx, &internal, nullptr, &b.pub[i])
+				|| !secp256k1_xonly_pubkey_tweak_add(ctx, &output, &internal, tweaks[i])) {
+				b.taprootKey[i] = {}; // Tweak over the group order, never matches
+				continue;
+			}
+			secp256k1_ec_pubkey_serialize(ctx, serialized, &len, &output, SECP256K1_EC_COMPRESSED);
+			std::copy_n(serialized + 1, 32, b.taprootKey[i].begin());
+		}
+		clock.lap(StageEC);
+		clock.taproot += clock.last - start;
+	}
+
+	secp256k1_context* ctx;
+	StageClock& clock;
+	bool enabled;
+	uint32_t midstate[8];
+	uint8_t tweaks[batchSize][32];
+};
+
+// Deriver: hash160 of the compressed pubkey, shared by P2PKH and P2WPKH
+// plus the P2SH-P2WPKH script hash when that format is searched
+struct CompressedDeriver {
+	static bool enabled(Options const&) { return true; }
+
+	explicit CompressedDeriver(WorkerContext& wc) : ctx{ wc.ctx }, clock{ wc.clock }, lanes{ wc.opts.lanes }, nested{ wc.opts.vanity.empty() && (wc.opts.formats & FormatP2SHP2WPKH) != 0 }, taproot{ wc } {}
+
+	void derive(Batch& b, size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			size_t len = 33;
+			secp256k1_ec_pubkey_serialize(ctx, keys[i], &len, &b.pub[i], SECP256K1_EC_COMPRESSED);
+		}
+		clock.lap(StageEC);
+		hash160Lanes(keys, n, b.hash160.data(), lanes, &clock);
+		if (nested) nestedScriptHash160s(b.hash160.data(), n, b.scriptHash160.data(), clock);
+		if (taproot.enabled) taproot.run(b, keys, n);
+	}
+
+	secp256k1_context* ctx;
+	StageClock& clock;
+	unsigned lanes;
+	bool nested;
+	TaprootStage taproot;
+	uint8_t keys[batchSize][33];
+};
+
+// Deriver: the same plus the legacy P2PKH of the uncompressed pubkey, --formats p2pkh-uncompressed
+// The point is serialized once as 04 | x | y and the compressed key is 02/03 by the parity of y | x,
+// so the extra format costs hashing only, no EC operation
+struct UncompressedDeriver {
+	static bool enabled(Options const& opts) { return opts.vanity.empty() && (opts.formats & FormatP2PKHUncompressed) != 0; }
+
+	explicit UncompressedDeriver(WorkerContext& wc) : ctx{ wc.ctx }, clock{ wc.clock }, lanes{ wc.opts.lanes }, nested{ (wc.opts.formats & FormatP2SHP2WPKH) != 0 }, taproot{ wc } {}
+
+	void derive(Batch& b, size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			size_t len = 65;
+			secp256k1_ec_pubkey_serialize(ctx, full[i], &len, &b.pub[i], SECP256K1_EC_UNCOMPRESSED);
+			keys[i][0] = 0x02 | (full[i][64] & 1);
+			std::memcpy(keys[i] + 1, full[i] + 1, 32);
+		}
+		clock.lap(StageEC);
+		hash160Lanes(keys, n, b.hash160.data(), lanes, &clock);
+		hash160Lanes(full, n, b.uncompressedHash160.data(), lanes, &clock);
+		if (nested) nestedScriptHash160s(b.hash160.data(), n, b.scriptHash160.data(), clock);
+		if (taproot.enabled) taproot.run(b, keys, n);
+	}
+
+	secp256k1_context* ctx;
+	StageClock& clock;
+	unsigned lanes;
+	bool nested;
+	TaprootStage taproot;
+	uint8_t keys[batchSize][33];
+	uint8_t full[batchSize][65];
+};
+
+// Matcher: one (type, hash160) lookup per searched format in the addr directory, no address encoding
+struct AddressMatcher {
+	static bool enabled(Options const&) { return true; }
+
+	explicit AddressMatcher(WorkerContext& wc) : formats{ wc.opts.formats }, probes{ static_cast<unsigned>(std::popcount(wc.opts.formats)) }, clock{ wc.clock }, counts{ wc.counts } {}
+
+	// Lookups of the whole batch first, then the hits are encoded and reported
+	template<typename Reporter>
+	void match(Batch const& b, size_t n, Reporter& reporter) {
+		found.clear();
+		// One tight loop per enabled format, the format test is per batch rather than per key
+		if (formats & FormatP2PKH) probe(n, AddressType::P2PKH, b.hash160);
+		if (formats & FormatP2WPKH) probe(n, AddressType::P2WPKH, b.hash160);
+		if (formats & FormatP2SHP2WPKH) probe(n, AddressType::P2SH, b.scriptHash160);
+		if (formats & FormatP2PKHUncompressed) probe(n, AddressType::P2PKH, b.uncompressedHash160);
+		if (formats & FormatP2TR) {
+			for (size_t i = 0; i < n; i++) {
+				if (auto res = checkXOnly(b.taprootKey[i])) found.push_back({ i, b.taprootKey[i], res });
+			}
+		}
+		counts.lookups += n * probes;
+		counts.candidates += found.size();
+		clock.lap(StageLookup);
+		for (auto const& hit : found) {
+			forEachChain(*hit.funded, [&](Funded const& f) {
+				auto address = std::visit([&](auto const& key) { return encodeAddress(key, f.network); }, hit.key);
+				reporter.report(b.prv[hit.i], address, f.balance, f.network);
+				counts.hits++;
+			});
+		}
+		clock.lap(StageReport);
+	}
+
+	void probe(size_t n, AddressType type, std::array<std::array<uint8_t, 20>, batchSize> const& hashes) {
+		for (size_t i = 0; i < n; i++) {
+			TypedHash160 key{ type, hashes[i] };
+			auto res = checkHash160(key); // Check if the output is found in the addr directory, on any chain
+			if (res) found.push_back({ i, key, res });
+		}
+	}
+
+	struct Found {
+		size_t i;
+		IndexKey key;
+		Funded const* funded;
+	};
+
+	unsigned formats;
+	unsigned probes; // Per key, one per format
+	StageClock& clock;
+	BatchCounts& counts;
+	std::vector<Found> found;
+};
+
+// Matcher: hash160 interval test against the vanity prefixes, base58 only for the rare candidates
+struct VanityMatcher {
+	static bool enabled(Options const& opts) { return !opts.vanity.empty(); }
+
+	// Built after the key source, which tells whether its keys come in walks
+	explicit VanityMatcher(WorkerContext& wc) : clock{ wc.clock }, counts{ wc.counts }, walk{ wc.walk }, spent{ wc.walkSpent } {}
+
+	// Interval and mask tests of the whole batch first, then the base58 check and report of the candidates
+	template<typename Reporter>
+	void match(Batch const& b, size_t n, Reporter& reporter) {
+		// bc1q prefixes are fixed leading bits of the hash160, one mask test per pattern for the whole batch
+		std::array<uint8_t, batchSize> segwit{};
+		if (vanityPatterns.hasSegwit()) {
+			vanityPatterns.matchSegwit(b.hash160.data(), n, segwit.data());
+		}
+		std::array<uint8_t, batchSize> legacy;
+		for (size_t i = 0; i < n; i++) {
+			legacy[i] = vanityPatterns.contains(b.hash160[i]);
+		}
+		counts.lookups += n;
+		clock.lap(StageLookup);
+		// One key per random walk at most, the source starts a new walk after a hit and the rest of the batch is dropped
+		// Range scans report every key
+		for (size_t i = 0; i < n && !spent; i++) {
+			if (legacy[i]) {
+				counts.candidates++;
+				auto address = arrToStr(hash160ToAddress(b.hash160[i]));
+				if (vanityPatterns.matchAddress(address)) {
+					reporter.report(b.prv[i], address, 0);
+					counts.hits++;
+					spent = walk;
+					continue;
+				}
+				counts.falsePositives++;
+			}
+			if (segwit[i]) {
+				// The mask test is exact
+				counts.candidates++;
+				reporter.report(b.prv[i], segwitAddress("bc", 0, b.hash160[i].data(), b.hash160[i].size()), 0);
+				counts.hits++;
+				spent = walk;
+			}
+		}
+		clock.lap(StageReport);
+	}
+
+	StageClock& clock;
+	BatchCounts& counts;
+	bool walk;
+	bool& spent;
+};
+
+// Hit found by a worker, checked and written by the reporter thread
+struct Hit {
+	std::array<uint8_t, 32> prv;
+	std::string address;
+	uint64_t balance;
+	std::string finder; // Remote worker name, empty for local threads
+	Network network = Network::Bitcoin;
+};
+
+// Hits waiting to be sent to the coordinator (worker mode)
+static std::mutex remoteHitsMutex;
+static std::vector<std::string> remoteHits;
+
+// Owns the only thread doing hit I/O, workers just push onto a lock-free queue
+// Each hit is deduplicated, derived again from its private key, then appended to one synced results file
+class HitReporter {
+public:
+	void start(Options const& opts) {
+		mode = opts.mode;
+		vanity = !opts.vanity.empty();
+		keepGoing = opts.keepGoing;
+		splitKey = opts.splitKey;
+		log = std::make_unique<HitLog>(std::filesystem::current_path().string() + "/walletminer.balance.txt");
+		thread = std::thread{ [this] { run(); } };
+	}
+
+	void push(Hit hit) {
+		queued++; // Before the push, drain() must never see it handled but not queued
+		queue.push(std::move(hit));
+	}
+
+	// Waits until every hit pushed so far is handled
+	void drain() {
+		uint64_t target = queued;
+		for (uint64_t h = handled; h < target; h = handled) {
+			handled.wait(h);
+		}
+	}
+
+	// Handles what is left in the queue, then ends the thread
+	void stop() {
+		if (!thread.joinable()) return;
+		stopping = true;
+		queue.wake();
+		thread.join();
+	}
+
+private:
+	void run() {
+		secp256k1_context* ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+		if (splitKey) {
+			uint8_t serialized[33];
+			size_t len = sizeof(serialized);
+			secp256k1_ec_pubkey_serialize(ctx, serialized, &len, &*splitKey, SECP256K1_EC_COMPRESSED);
+			std::ostringstream os;
+			for (uint8_t c : serialized) os << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(c);
+			splitKeyHex = os.str();
+		}
+		while (true) {
+			uint64_t version = queue.version();
+			while (auto hit = queue.pop()) {
+				handle(*hit, ctx);
+				handled++;
+				handled.notify_all();
+			}
+			if (stopping && handled == queued) break;
+			queue.wait(version);
+		}
+		secp256k1_context_destroy(ctx);
+	}
+
+	void handle(Hit const& hit, secp256k1_context* ctx) {
+		if (!seen.insert({ hit.prv, hit.address, hit.network }).second) return; // Already written
+		if (!verify(hit, ctx)) {
+			std::cout << std::endl << "Rejected a hit on " << hit.address << ", the private key does not derive to it" << std::endl;
+			return;
+		}
+
+		if (vanity) {
+			std::string const& prefix = *vanityPatterns.matchAddress(hit.address);
+			std::cout << std::endl << "-------------------- VANITY ADDRESS FOUND: " << hit.address << " --------------------" << std::endl;
+			std::string line{ prvKeyToString(hit.prv) + " => [" + hit.address + "]" + ", PREFIX: " + prefix + "\n" };
+			if (splitKey) {
+				// Only the owner of Q can add its private key to the tweak
+				line = "TWEAK " + prvKeyToString(hit.prv) + " FOR " + splitKeyHex + " => [" + hit.address + "]" + ", PREFIX: " + prefix + "\n";
+				std::cout << "Private key = private key of " << splitKeyHex << " + " << prvKeyToString(hit.prv) << " mod n" << std::endl;
+			}
+			if (!log->write(line)) {
+				std::cout << "Cannot write to walletminer.balance.txt: " << line << std::flush;
+			}
+			foundPrefixes.insert(prefix);
+			if (!keepGoing && foundPrefixes.size() == vanityPatterns.patterns().size()) {
+				stopRequested = true; // Every prefix has its address
+			}
+			return;
+		}
+
+		std::cout << std::endl << "-------------------- NON NULL BALANCE FOUND" << (hit.finder.empty() ? "" : " BY " + hit.finder) << " --------------------" << std::endl;
+		auto const& params = networkParams(hit.network);
+		std::string chain = hit.network == Network::Bitcoin ? "" : std::string{ ", CHAIN: " } + params.name;
+		std::string addrBal{ prvKeyToString(hit.prv) + " => [" + hit.address + "]" + chain + ", BALANCE: " + std::to_string(hit.balance) + params.unit + "\n" };
+		if (!log->write(addrBal)) {
+			std::cout << "Cannot write to walletminer.balance.txt: " << addrBal << std::flush;
+		}
+		if (mode == Options::Mode::Worker) {
+			std::lock_guard lock{ remoteHitsMutex };
+			remoteHits.push_back("HIT " + prvKeyToString(hit.prv) + " " + hit.address + " " + std::to_string(hit.balance) + " " + networkParams(hit.network).name);
+		}
+	}
+
+	// Reference derivation, independent of the batched pipeline that found the hit
+	bool verify(Hit const& hit, secp256k1_context* ctx) const {
+		secp256k1_pubkey pubkey;
+		if (!checkValidPrvKey(hit.prv)) return false;
+		if (splitKey) {
+			pubkey = *splitKey;
+			if (secp256k1_ec_pubkey_tweak_add(ctx, &pubkey, hit.prv.data()) == 0) return false;
+		}
+		else if (secp256k1_ec_pubkey_create(ctx, &pubkey, hit.prv.data()) == 0) {
+			return false;
+		}
+		auto derived = derivedAddresses(pubkey, ctx, hit.network);
+		if (std::find(derived.begin(), derived.end(), hit.address) == derived.end()) return false;
+		if (vanity) return vanityPatterns.matchAddress(hit.address) != nullptr;
+		// The coordinator has no balance file, its workers checked the balance
+		return mode == Options::Mode::Coordinator || checkAddress(hit.address, hit.network) == hit.balance;
+	}
+
+	Options::Mode mode = Options::Mode::Miner;
+	bool vanity = false;
+	bool keepGoing = false;
+	std::optional<secp256k1_pubkey> splitKey;
+	std::string splitKeyHex; // Compressed, reporter thread only
+	std::set<std::string> foundPrefixes;
+	std::unique_ptr<HitLog> log;
+	std::thread thread;
+	MpscQueue<Hit> queue;
+	std::atomic<uint64_t> queued{ 0 };
+	std::atomic<uint64_t> handled{ 0 };
+	std::atomic<bool> stopping{ false };
+	std::set<std::tuple<std::array<uint8_t, 32>, std::string, Network>> seen; // Reporter thread only
+};
+
+static HitReporter hitReporter;
+
+// Reporter: hands the hit over to the reporter thread, never waits on I/O
+struct QueueReporter {
+	static bool enabled(Options const&) { return true; }
+
+	explicit QueueReporter(WorkerContext&) {}
+
+	void report(std::array<uint8_t, 32> const& prv, std::string const& address, uint64_t balance, Network network = Network::Bitcoin) {
+		hitReporter.push({ prv, address, balance, {}, network });
+	}
+};
+
+// Hardware counters of a worker, --perf, read once per batch and published as deltas
+// Without access the search runs as usual and the reason is printed once
+struct HwSampler {
+	explicit HwSampler(WorkerContext& wc) : stats{ wc.stats } {
+		if (!wc.opts.perf) return;
+		auto error = group.open();
+		if (!error.empty()) {
+			if (!hwWarned.exchange(true)) std::cout << "Hardware counters not available: " << error << std::endl;
+			return;
+		}
+		unsigned mask = 0;
+		for (unsigned c = 0; c < hwCount; c++) {
+			if (group.has(HwCounter(c))) mask |= 1u << c;
+		}
+		stats.hwMask = mask;
+		enabled = group.read(last);
+	}
+
+	// Counts since the previous batch, nullptr without counters
+	uint64_t const* sample() {
+		if (!enabled) return nullptr;
+		uint64_t now[hwCount];
+		std::copy(std::begin(last), std::end(last), now);
+		for (auto& d : delta) d = 0;
+		if (!group.read(now)) return delta;
+		for (unsigned c = 0; c < hwCount; c++) {
+			// Scaled counts of a multiplexed group can step back a little
+			if (now[c] > last[c]) {
+				delta[c] = now[c] - last[c];
+				last[c] = now[c];
+			}
+		}
+		return delta;
+	}
+
+	WorkerStats& stats;
+	PerfGroup group;
+	bool enabled = false;
+	uint64_t last[hwCount] = {};
+	uint64_t delta[hwCount] = {};
+};
+
+// The worker loop, specialised at compile time for one combination of policies
+template<typename KeySource, typename Deriver, typename Matcher, typename Reporter>
+struct Worker {
+	static void run(WorkerContext& wc) {
+		KeySource source{ wc };
+		Deriver deriver{ wc };
+		Matcher matcher{ wc };
+		Reporter reporter{ wc };
+		HwSampler hw{ wc };
+
+		auto batch = std::make_unique<Batch>();
+		while (!stopRequested) {
+			// Each stage laps the clock when it is done with the batch
+			wc.clock.start();
+			size_t n = source.fill(*batch);
+			if (n == 0) break;
+			deriver.derive(*batch, n); // Extract the pubs
+			matcher.match(*batch, n, reporter);
+			wc.stats.add(n, wc.clock, wc.counts, hw.sample());
+			testedKeys += n;
+		}
+	}
+};
+
+// Supported policies, the last one of each list is the default
+using KeySources = PolicyList<RangeKeySource, RandomWalkKeySource, RandomKeySource>;
+using Derivers = PolicyList<UncompressedDeriver, CompressedDeriver>;
+using Matchers = PolicyList<VanityMatcher, AddressMatcher>;
+using Reporters = PolicyList<QueueReporter>;
+using Pipeline = PipelineTable<Worker, WorkerContext, KeySources, Derivers, Matchers, Reporters>;
+
+// Picks the worker specialisation matching the options, once at startup
+Pipeline::Fn selectPipeline(Options const& opts) {
+	return Pipeline::get(
+		PolicySelector<KeySources>::select(opts),
+		PolicySelector<Derivers>::select(opts),
+		PolicySelector<Matchers>::select(opts),
+		PolicySelector<Reporters>::select(opts)
+	);
+}
+
+void check(Options const& opts, unsigned id, Pipeline::Fn pipeline, RangeJob* range) {
+	secp256k1_context* ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+	WorkerContext wc{ opts, ctx, id, range, workerStats[id] };
+	pipeline(wc);
+	secp256k1_context_destroy(ctx);
+}
+
+// Distributed range scans
+//
+// Line based protocol, worker requests and coordinator replies:
+//   HELLO <name>                          OK
+//   LEASE <keys/s>                        LEASE <id> <next> <end> <stride> | WAIT <ms> | DONE
+//   PROGRESS <id> <tested keys> <keys/s>  OK | LOST
+//   COMPLETE <id> <tested keys> <keys/s>  OK | LOST
+//   RELEASE <id>                          OK
+//   HIT <prv> <address> <balance> [chain] OK
+// Tested keys is the worker's running total. Leases last leaseSeconds at the
+// worker's speed and progress is sent every progressEvery, so the protocol costs
+// a handful of round trips per minute and worker.
+// A worker holds up to two leases, it asks for the next one while its threads
+// still have work so they never wait on the coordinator.
+
+static constexpr uint64_t minLeaseKeys = 1 << 16;
+static constexpr auto progressEvery = seconds(10);
+
+std::string segmentToString(Segment const& seg) {
+	return u256ToHex(seg.next) + " " + u256ToHex(seg.end) + " " + std::to_string(seg.stride);
+}
+
+std::string hostName() {
+	char name[256] = { 0 };
+	if (gethostname(name, sizeof(name) - 1) != 0) return "worker";
+	return name;
+}
+
+// Keys/s and tested keys of the connected workers
+struct WorkerReport {
+	double speed = 0;
+	uint64_t keys = 0;
+};
+
+// Serves one worker connection until it closes
+void serveWorker(Socket& sock, LeaseLedger& ledger, Options const& opts, std::mutex& reportsMutex, std::map<Socket*, WorkerReport>& reports, std::atomic<uint64_t>& totalKeys) {
+	std::string name = "?";
+	std::string line;
+	auto timeout = seconds(opts.leaseTimeout);
+	auto account = [&](uint64_t keys, double speed) {
+		std::lock_guard lock{ reportsMutex };
+		auto& r = reports[&sock];
+		if (keys > r.keys) {
+			totalKeys += keys - r.keys;
+			r.keys = keys;
+		}
+		r.speed = speed;
+	};
+
+	while (sock.readLine(line)) {
+		std::istringstream is{ line };
+		std::string cmd;
+		is >> cmd;
+		if (cmd == "HELLO") {
+			is >> name;
+			std::cout << std::endl << "Worker " << name << " connected" << std::endl;
+			sock.sendLine("OK");
+		}
+		else if (cmd == "LEASE") {
+			double speed = 0;
+			is >> speed;
+			account(0, speed);
+			uint64_t keys = std::max<uint64_t>(minLeaseKeys, static_cast<uint64_t>(speed * opts.leaseSeconds));
+			auto lease = ledger.grant(name, keys, timeout);
+			if (lease) {
+				sock.sendLine("LEASE " + std::to_string(lease->id) + " " + segmentToString(lease->seg));
+			}
+			else if (ledger.finished()) {
+				sock.sendLine("DONE");
+			}
+			else {
+				sock.sendLine("WAIT 1000"); // Outstanding leases may still come back
+			}
+		}
+		else if (cmd == "PROGRESS") {
+			uint64_t id = 0, keys = 0;
+			double speed = 0;
+			is >> id >> keys >> speed;
+			account(keys, speed);
+			sock.sendLine(ledger.renew(id, timeout) ? "OK" : "LOST");
+		}
+		else if (cmd == "COMPLETE") {
+			uint64_t id = 0, keys = 0;
+			double speed = 0;
+			is >> id >> keys >> speed;
+			account(keys, speed);
+			sock.sendLine(ledger.complete(id) ? "OK" : "LOST");
+		}
+		else if (cmd == "RELEASE") {
+			uint64_t id = 0;
+			is >> id;
+			ledger.release(id);
+			sock.sendLine("OK");
+		}
+		else if (cmd == "HIT") {
+			std::string prv, address, chain;
+			uint64_t balance = 0;
+			is >> prv >> address >> balance >> chain;
+			try {
+				auto network = chain.empty() ? Network::Bitcoin : networkFromName(chain);
+				if (!network) throw std::runtime_error{ "unknown chain " + chain };
+				hitReporter.push({ u256FromHex(prv), address, balance, name, *network });
+				sock.sendLine("OK");
+			}
+			catch (const std::exception& e) {
+				sock.sendLine(std::string{ "ERROR " } + e.what());
+			}
+		}
+		else {
+			sock.sendLine("ERROR unknown command");
+		}
+	}
+
+	std::lock_guard lock{ reportsMutex };
+	reports.erase(&sock);
+	std::cout << std::endl << "Worker " << name << " disconnected" << std::endl;
+}
+
+// Coordinator mode: owns the keyspace ledger and serves leases until the range is done
+int runCoordinator(Options const& opts) {
+	std::unique_ptr<LeaseLedger> ledger;
+	try {
+		auto cp = loadCheckpoint(opts.checkpointFile);
+		if (!cp) {
+			ledger = std::make_unique<LeaseLedger>(opts.start, opts.end);
+		}
+		else if (u256Cmp(cp->start, opts.start) != 0 || u256Cmp(cp->end, opts.end) != 0 || cp->interleave) {
+			std::cout << "Checkpoint " << opts.checkpointFile << " belongs to another range scan" << std::endl;
+			return 3;
+		}
+		else {
+			ledger = std::make_unique<LeaseLedger>(cp->state);
+			std::cout << "Resuming from " << opts.checkpointFile << std::endl;
+		}
+	}
+	catch (const std::exception& e) {
+		std::cout << e.what() << std::endl;
+		return 3;
+	}
+	auto save = [&opts, &ledger]() {
+		try {
+			saveCheckpoint(opts.checkpointFile, Checkpoint{ opts.start, opts.end, false, ledger->snapshot() });
+		}
+		catch (const std::exception& e) {
+			std::cout << std::endl << e.what() << std::endl;
+		}
+	};
+
+	std::unique_ptr<Listener> listener;
+	try {
+		listener = std::make_unique<Listener>(opts.listen);
+		hitReporter.start(opts);
+	}
+	catch (const std::exception& e) {
+		std::cout << e.what() << std::endl;
+		return 4;
+	}
+	std::cout << "Coordinating range " << u256ToHex(opts.start) << " - " << u256ToHex(opts.end) << " on " << opts.listen << std::endl;
+
+	std::mutex reportsMutex;
+	std::map<Socket*, WorkerReport> reports;
+	std::atomic<uint64_t> totalKeys = 0;
+	std::list<Socket> sockets;
+	std::vector<std::thread> clients;
+	std::thread acceptor{ [&]() {
+		while (true) {
+			Socket s = listener->accept();
+			if (!s.valid() || stopRequested) break;
+			std::lock_guard lock{ reportsMutex };
+			Socket& sock = sockets.emplace_back(std::move(s));
+			clients.emplace_back([&, sockPtr = &sock]() {
+				try {
+					serveWorker(*sockPtr, *ledger, opts, reportsMutex, reports, totalKeys);
+				}
+				catch (const std::exception& e) {
+					std::cout << std::endl << e.what() << std::endl;
+				}
+			});
+		}
+	} };
+
+	auto lastCheckpoint = steady_clock::now();
+	while (!stopRequested && !ledger->finished()) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		if (size_t n = ledger->expire()) {
+			std::cout << std::endl << n << " expired lease(s) issued again" << std::endl;
+		}
+		if (steady_clock::now() - lastCheckpoint >= seconds(opts.checkpointInterval)) {
+			save();
+			lastCheckpoint = steady_clock::now();
+		}
+		double speed = 0;
+		size_t workers;
+		{
+			std::lock_guard lock{ reportsMutex };
+			for (auto const& r : reports) speed += r.second.speed;
+			workers = reports.size();
+		}
+		std::cout << "\r" << speed << " keys/s, " << workers << " workers, " << ledger->activeLeases() << " leases, " << totalKeys << " keys tested             " << std::flush;
+	}
+	save();
+
+	// Workers still connected get DONE on their next lease request
+	if (!stopRequested) {
+		auto deadline = steady_clock::now() + progressEvery * 2;
+		while (steady_clock::now() < deadline) {
+			{
+				std::lock_guard lock{ reportsMutex };
+				if (reports.empty()) break;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
+	}
+
+	stopRequested = true;
+	listener->shutdown();
+	acceptor.join();
+	{
+		std::lock_guard lock{ reportsMutex };
+		for (auto& s : sockets) s.shutdown();
+	}
+	for (auto& t : clients) t.join();
+	hitReporter.stop();
+
+	std::cout << std::endl << (ledger->finished() ? "Range scan complete" : "Stopped, progress saved to " + opts.checkpointFile) << std::endl;
+	return 0;
+}
+
+// Worker mode: fetches leases from the coordinator and feeds them to the local threads
+// Returns false if the coordinator could not be reached
+bool remoteClient(Options const& opts, RangeJob& job) {
+	bool ok = true;
+	try {
+		Socket sock = connectTo(opts.connect);
+		auto request = [&sock](std::string const& line) {
+			sock.sendLine(line);
+			std::string reply;
+			if (!sock.readLine(reply)) throw std::runtime_error{ "Coordinator closed the connection" };
+			return reply;
+		};
+		request("HELLO " + hostName());
+
+		// Held leases, the next one is fetched and submitted while the threads still have
+		// a couple of chunks each, so they never wait for a round trip between two leases
+		struct HeldLease {
+			uint64_t id;
+			Segment seg;
+		};
+		std::vector<HeldLease> leases;
+		static constexpr size_t maxLeases = 2;
+		auto lastComplete = steady_clock::now();
+		uint64_t lastCompleteKeys = testedKeys;
+		auto lastProgress = steady_clock::now();
+		uint64_t lastProgressKeys = testedKeys;
+		auto nextLease = steady_clock::now(); // Later after a WAIT
+		bool done = false; // Nothing left to lease, the held leases are finished first
+		double speed = 0;
+
+		while (!stopRequested) {
+			std::vector<std::string> hits;
+			{
+				std::lock_guard lock{ remoteHitsMutex };
+				hits.swap(remoteHits);
+			}
+			for (auto const& h : hits) request(h);
+
+			// Leases can end in any order, the threads steal the chunks of each other
+			for (auto it = leases.begin(); it != leases.end();) {
+				if (!job.tested(it->seg)) {
+					++it;
+					continue;
+				}
+				uint64_t keys = testedKeys;
+				double elapsed = duration<double>(steady_clock::now() - lastComplete).count();
+				if (elapsed > 0) speed = (keys - lastCompleteKeys) / elapsed;
+				lastComplete = steady_clock::now();
+				lastCompleteKeys = keys;
+				request("COMPLETE " + std::to_string(it->id) + " " + std::to_string(keys) + " " + std::to_string(static_cast<uint64_t>(speed)));
+				it = leases.erase(it);
+			}
+			if (done && leases.empty()) break;
+
+			// Speed is 0 until the first lease is done, the next one is then fetched once everything is handed out
+			double ahead = 2 * RangeJob::targetChunkSeconds * speed;
+			if (!done && leases.size() < maxLeases && steady_clock::now() >= nextLease && job.pendingKeys() <= ahead) {
+				std::istringstream reply{ request("LEASE " + std::to_string(static_cast<uint64_t>(speed))) };
+				std::string type;
+				reply >> type;
+				if (type == "LEASE") {
+					HeldLease held;
+					std::string next, end;
+					reply >> held.id >> next >> end >> held.seg.stride;
+					held.seg.next = u256FromHex(next);
+					held.seg.end = u256FromHex(end);
+					if (leases.empty()) {
+						// Time spent without work is not part of the speed
+						lastComplete = steady_clock::now();
+						lastCompleteKeys = testedKeys;
+					}
+					leases.push_back(held);
+					job.submit(held.seg);
+				}
+				else if (type == "WAIT") {
+					unsigned ms = 1000;
+					reply >> ms;
+					nextLease = steady_clock::now() + std::chrono::milliseconds(ms);
+				}
+				else if (type == "DONE") {
+					done = true;
+				}
+				else {
+					throw std::runtime_error{ "Unexpected reply from the coordinator: " + type };
+				}
+				continue;
+			}
+
+			if (!leases.empty() && steady_clock::now() - lastProgress >= progressEvery) {
+				uint64_t keys = testedKeys;
+				speed = (keys - lastProgressKeys) / duration<double>(steady_clock::now() - lastProgress).count();
+				lastProgress = steady_clock::now();
+				lastProgressKeys = keys;
+				// LOST means the lease was issued again after a timeout, finishing it is still harmless
+				for (auto const& held : leases) {
+					request("PROGRESS " + std::to_string(held.id) + " " + std::to_string(keys) + " " + std::to_string(static_cast<uint64_t>(speed)));
+				}
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		}
+
+		// Let the threads end their last batch, then send the hits still on their way
+		job.close();
+		while (runningWorkers > 0) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		}
+		hitReporter.drain();
+		{
+			std::lock_guard lock{ remoteHitsMutex };
+			for (auto const& h : remoteHits) request(h);
+			remoteHits.clear();
+		}
+
+		// Interrupted, let another worker take them now
+		for (auto const& held : leases) {
+			request("RELEASE " + std::to_string(held.id));
+		}
+	}
+	catch (const std::exception& e) {
+		std::cout << std::endl << e.what() << std::endl;
+		ok = false;
+		stopRequested = true;
+	}
+	job.close();
+	return ok;
+}
+
+void printUsage() {
+	std::cout << "Usage WalletMiner.exe [options] <[chain:]balance_file>..." << std::endl;
+	std::cout << "      WalletMiner.exe coordinator --listen <host:port|unix:path> --start <hex> --end <hex> [options]" << std::endl;
+	std::cout << "      WalletMiner.exe worker --connect <host:port|unix:path> [options] <[chain:]balance_file>..." << std::endl;
+	std::cout << "  chain: bitcoin (default), testnet, litecoin, dogecoin, bitcoin-cash (legacy addresses)" << std::endl;
+	std::cout << "  --threads <n>       Number of worker threads" << std::endl;
+	std::cout << "  --batch-keys <n>    Keys per batch, up to 256" << std::endl;
+	std::cout << "  --lanes <n>         Width of the hash160 lane kernels, 4, 8 or 16" << std::endl;
+	std::cout << "  --autotune          Pick threads, batch keys and lanes by short trials, kept per host in walletminer.tune.txt" << std::endl;
+	std::cout << "  --retune            With --autotune, run the trials again even if this host is known" << std::endl;
+	std::cout << "  --perf              Read hardware counters of the workers (IPC, cache, TLB and branch misses), Linux" << std::endl;
+	std::cout << "  --metrics <addr>    Serve Prometheus metrics on http://addr/metrics, a port alone listens on 127.0.0.1" << std::endl;
+	std::cout << "  --formats <list>    Address formats to derive, default p2pkh,p2wpkh,p2sh-p2wpkh, also p2pkh-uncompressed and p2tr" << std::endl;
+	std::cout << "  --start <hex>       First private key of a range scan" << std::endl;
+	std::cout << "  --end <hex>         Last private key of a range scan (included)" << std::endl;
+	std::cout << "  --interleave        Give each thread a stride of the range instead of a sub range" << std::endl;
+	std::cout << "  --checkpoint <file> Range scan progress file, resumed on restart" << std::endl;
+	std::cout << "  --checkpoint-interval <s>  Seconds between two checkpoints" << std::endl;
+	std::cout << "  --lease-seconds <s> Coordinator: lease size in seconds of the worker's speed" << std::endl;
+	std::cout << "  --lease-timeout <s> Coordinator: delay after which a silent lease is issued again" << std::endl;
+	std::cout << "  --vanity <prefix>   Search an address starting with prefix instead (1... or bc1q...), repeatable, no balance file" << std::endl;
+	std::cout << "  --vanity-file <f>   Vanity prefixes, one per line" << std::endl;
+	std::cout << "  --ignore-case       Vanity: match prefixes whatever their case" << std::endl;
+	std::cout << "  --keep-going        Vanity: keep searching once every prefix is found" << std::endl;
+	std::cout << "  --split-key <hex>   Vanity: search Q + tG for the given public key Q and only output the tweak t" << std::endl;
+	std::cout << "  --bench             Run the workers for a fixed time and print keys/s and stage times as JSON" << std::endl;
+	std::cout << "                      Balance files are optional, a synthetic index is used without them" << std::endl;
+	std::cout << "  --duration <t>      Bench: run time, 90, 90s, 5m or 1h, default 10s" << std::endl;
+	std::cout << "  --bench-index <n>   Bench: outputs of the synthetic index, default 1000000" << std::endl;
+	std::cout << "  --json <file>       Bench: also write the JSON to file" << std::endl;
+	std::cout << "  --scaling           Bench every thread count, 1, 2, 4... one per core then with SMT siblings, --duration each" << std::endl;
+}
+
+// Seconds of 90, 90s, 5m or 1h
+double parseDuration(std::string const& text) {
+	size_t pos = 0;
+	double value = std::stod(text, &pos);
+	std::string unit = text.substr(pos);
+	double scale = unit.empty() || unit == "s" ? 1 : unit == "m" ? 60 : unit == "h" ? 3600 : 0;
+	if (scale == 0 || !(value > 0)) throw std::runtime_error{ "Invalid duration " + text };
+	return value * scale;
+}
+
+// Throws on invalid arguments
+// Widths with a hash160 lane kernel, the dispatch falls back to 8 for anything else
+bool validLanes(unsigned lanes) {
+	return lanes == 4 || lanes == 8 || lanes == 16;
+}
+
+Options parseOptions(int argc, char** argv) {
+	Options opts;
+	bool hasStart = false, hasEnd = false;
+
+	int first = 1;
+	if (argc > 1 && std::string{ argv[1] } == "coordinator") {
+		opts.mode = Options::Mode::Coordinator;
+		first = 2;
+	}
+	else if (argc > 1 && std::string{ argv[1] } == "worker") {
+		opts.mode = Options::Mode::Worker;
+		first = 2;
+	}
+
+	for (int i = first; i < argc; i++) {
+		std::string arg{ argv[i] };
+		auto value = [&]() -> std::string {
+			if (i + 1 >= argc) throw std::runtime_error{ "Missing value for " + arg };
+			return argv[++i];
+		};
+
+		if (arg == "--threads") {
+			opts.threads = static_cast<unsigned>(std::stoul(value()));
+		}
+		else if (arg == "--batch-keys") {
+			opts.batchKeys = static_cast<unsigned>(std::stoul(value()));
+			if (opts.batchKeys == 0 || opts.batchKeys > batchSize) throw std::runtime_error{ "--batch-keys must be from 1 to " + std::to_string(batchSize) };
+		}
+		else if (arg == "--lanes") {
+			opts.lanes = static_cast<unsigned>(std::stoul(value()));
+			if (!validLanes(opts.lanes)) throw std::runtime_error{ "--lanes must be 4, 8 or 16" };
+		}
+		else if (arg == "--autotune") {
+			opts.autotune = true;
+		}
+		else if (arg == "--retune") {
+			opts.autotune = true;
+			opts.retune = true;
+		}
+		else if (arg == "--perf") {
+			opts.perf = true;
+		}
+		else if (arg == "--metrics") {
+			opts.metrics = value();
+		}
+		else if (arg == "--formats") {
+			opts.formats = 0;
+			std::istringstream list{ value() };
+			std::string name;
+			while (std::getline(list, name, ',')) {
+				if (name == "p2pkh") opts.formats |= FormatP2PKH;
+				else if (name == "p2wpkh") opts.formats |= FormatP2WPKH;
+				else if (name == "p2sh-p2wpkh") opts.formats |= FormatP2SHP2WPKH;
+				else if (name == "p2pkh-uncompressed") opts.formats |= FormatP2PKHUncompressed;
+				else if (name == "p2tr") opts.formats |= FormatP2TR;
+				else throw std::runtime_error{ "Unknown address format " + name };
+			}
+			if (!opts.formats) throw std::runtime_error{ "--formats needs at least one format" };
+		}
+		else if (arg == "--start") {
+			opts.start = u256FromHex(value());
+			hasStart = true;
+		}
+		else if (arg == "--end") {
+			opts.end = u256FromHex(value());
+			hasEnd = true;
+		}
+		else if (arg == "--interleave") {
+			opts.interleave = true;
+		}
+		else if (arg == "--checkpoint") {
+			opts.checkpointFile = value();
+		}
+		else if (arg == "--checkpoint-interval") {
+			opts.checkpointInterval = static_cast<unsigned>(std::stoul(value()));
+		}
+		else if (arg == "--listen") {
+			opts.listen = value();
+		}
+		else if (arg == "--connect") {
+			opts.connect = value();
+		}
+		else if (arg == "--lease-seconds") {
+			opts.leaseSeconds = static_cast<unsigned>(std::stoul(value()));
+		}
+		else if (arg == "--lease-timeout") {
+			opts.leaseTimeout = static_cast<unsigned>(std::stoul(value()));
+		}
+		else if (arg == "--vanity") {
+			opts.vanity.push_back(value());
+		}
+		else if (arg == "--vanity-file") {
+			std::string path = value();
+			std::ifstream is{ path };
+			if (!is) throw std::runtime_error{ "Cannot open " + path };
+			std::string line;
+			while (std::getline(is, line)) {
+				line.erase(std::remove_if(line.begin(), line.end(), [](unsigned char c) { return std::isspace(c); }), line.end());
+				if (!line.empty() && line[0] != '#') opts.vanity.push_back(line);
+			}
+			if (opts.vanity.empty()) throw std::runtime_error{ "No prefix in " + path };
+		}
+		else if (arg == "--ignore-case") {
+			opts.ignoreCase = true;
+		}
+		else if (arg == "--split-key") {
+			std::string hex = value();
+			if (hex.size() % 2 || !std::all_of(hex.begin(), hex.end(), [](unsigned char c) { return std::isxdigit(c); })) {
+				throw std::runtime_error{ "--split-key takes a hex encoded public key" };
+			}
+			std::vector<uint8_t> bytes;
+			for (size_t j = 0; j < hex.size(); j += 2) {
+				bytes.push_back(static_cast<uint8_t>(std::stoul(hex.substr(j, 2), nullptr, 16)));
+			}
+			secp256k1_context* ctx = secp256k1_context_create(SECP256K1_CONTEXT_NONE);
+			secp256k1_pubkey q;
+			bool ok = secp256k1_ec_pubkey_parse(ctx, &q, bytes.data(), bytes.size());
+			secp256k1_context_destroy(ctx);
+			if (!ok) throw std::runtime_error{ "Invalid public key for --split-key" };
+			opts.splitKey = q;
+		}
+		else if (arg == "--keep-going") {
+			opts.keepGoing = true;
+		}
+		else if (arg == "--bench") {
+			opts.bench = true;
+		}
+		else if (arg == "--duration") {
+			opts.benchSeconds = parseDuration(value());
+		}
+		else if (arg == "--bench-index") {
+			opts.benchIndex = std::stoull(value());
+		}
+		else if (arg == "--json") {
+			opts.jsonFile = value();
+		}
+		else if (arg == "--scaling") {
+			opts.bench = true;
+			opts.scaling = true;
+		}
+		else if (arg.starts_with("--")) {
+			throw std::runtime_error{ "Unknown option " + arg };
+		}
+		else {
+			// litecoin:ltc.tsv, a prefix that is not a chain name is part of the path (M:\dump.tsv)
+			auto colon = arg.find(':');
+			auto network = colon == std::string::npos ? std::nullopt : networkFromName(std::string_view{ arg }.substr(0, colon));
+			if (network) opts.balanceFiles.emplace_back(*network, arg.substr(colon + 1));
+			else opts.balanceFiles.emplace_back(Network::Bitcoin, arg);
+		}
+	}
+
+	if (opts.splitKey && (opts.vanity.empty() || hasStart)) {
+		throw std::runtime_error{ "--split-key needs --vanity and searches random tweaks, not a range" };
+	}
+	if (!opts.vanity.empty() && opts.mode != Options::Mode::Miner) {
+		throw std::runtime_error{ "--vanity cannot be used in coordinator or worker mode" };
+	}
+	if (opts.autotune && opts.mode == Options::Mode::Coordinator) {
+		throw std::runtime_error{ "--autotune is for the processes running workers" };
+	}
+	if (!opts.metrics.empty() && opts.mode == Options::Mode::Coordinator) {
+		throw std::runtime_error{ "--metrics is for the processes running workers" };
+	}
+	if (opts.bench && opts.mode != Options::Mode::Miner) {
+		throw std::runtime_error{ "--bench runs standalone, not in coordinator or worker mode" };
+	}
+	if (opts.balanceFiles.empty() && opts.mode != Options::Mode::Coordinator && opts.vanity.empty() && !opts.bench) {
+		throw std::runtime_error{ "Missing balance file" };
+	}
+	if (opts.threads == 0) {
+		throw std::runtime_error{ "Thread count must be at least 1" };
+	}
+	if (hasStart != hasEnd) {
+		throw std::runtime_error{ "--start and --end go together" };
+	}
+	if (hasStart) {
+		if (u256IsZero(opts.start) || !checkValidPrvKey(opts.end) || u256Cmp(opts.start, opts.end) > 0) {
+			throw std::runtime_error{ "Range must satisfy 0 < start <= end < N" };
+		}
+		opts.rangeScan = true;
+	}
+	else if (opts.interleave) {
+		throw std::runtime_error{ "--interleave needs --start and --end" };
+	}
+
+	if (opts.mode == Options::Mode::Coordinator) {
+		if (opts.listen.empty() || !hasStart) {
+			throw std::runtime_error{ "coordinator needs --listen, --start and --end" };
+		}
+		if (opts.interleave) {
+			throw std::runtime_error{ "coordinator leases contiguous chunks, --interleave is not supported" };
+		}
+		if (opts.leaseTimeout <= duration_cast<seconds>(progressEvery).count()) {
+			throw std::runtime_error{ "--lease-timeout must exceed the progress interval" };
+		}
+	}
+	if (opts.mode == Options::Mode::Worker) {
+		if (opts.connect.empty() || hasStart) {
+			throw std::runtime_error{ "worker needs --connect and gets its range from the coordinator" };
+		}
+		opts.rangeScan = true;
+	}
+	return opts;
+}
+
+struct BenchReport {
+	double seconds = 0; // From the start of the workers to the end of their last batch
+	unsigned threads = 0;
+	bool interrupted = false; // Ctrl+C before the end
+	std::vector<uint64_t> threadKeys;
+	StatsTotals totals;
+};
+
+// Runs the selected pipeline on opts.threads workers for opts.benchSeconds, or until the range is scanned
+// The workers are stopped between two batches, every key counted has been fully tested
+BenchReport runBench(Options const& opts) {
+	std::unique_ptr<RangeJob> range;
+	if (opts.rangeScan) {
+		range = std::make_unique<RangeJob>(opts.start, opts.end, opts.threads, opts.interleave); // Never checkpointed
+	}
+	resetWorkerStats(opts);
+	Pipeline::Fn pipeline = selectPipeline(opts);
+	runningWorkers = opts.threads;
+
+	auto start = steady_clock::now();
+	auto deadline = start + duration_cast<steady_clock::duration>(duration<double>(opts.benchSeconds));
+	std::vector<std::thread> threads;
+	for (unsigned i = 0; i < opts.threads; i++) {
+		threads.emplace_back([&opts, i, pipeline, &range]() {
+			try {
+				if (i < opts.cpus.size()) pinThread(opts.cpus[i]);
+				check(opts, i, pipeline, range.get());
+				runningWorkers--;
+			}
+			catch (const std::exception& e) {
+				std::cout << e.what() << std::endl;
+				exit(1);
+			}
+		});
+	}
+	while (runningWorkers > 0 && !stopRequested && steady_clock::now() < deadline) {
+		std::this_thread::sleep_for(std::min<steady_clock::duration>(milliseconds(50), deadline - steady_clock::now()));
+	}
+	BenchReport r;
+	r.interrupted = stopRequested;
+	stopRequested = true;
+	for (auto& t : threads) {
+		t.join();
+	}
+	stopRequested = r.interrupted;
+	r.seconds = duration<double>(steady_clock::now() - start).count();
+	r.threads = opts.threads;
+	for (unsigned i = 0; i < opts.threads; i++) {
+		r.threadKeys.push_back(workerStats[i].read().keys);
+	}
+	r.totals = sumWorkerStats(opts.threads);
+	return r;
+}
+
+void writeBenchJson(std::ostream& os, BenchReport const& r, Options const& opts) {
+	auto const& t = r.totals;
+	double mean = r.threads ? double(t.keys) / r.threads : 0;
+	double var = 0;
+	for (auto k : r.threadKeys) var += (k - mean) * (k - mean);
+	double stddev = r.threads ? std::sqrt(var / r.threads) : 0;
+	auto [minKeys, maxKeys] = std::minmax_element(r.threadKeys.begin(), r.threadKeys.end());
+	uint64_t batchTicks = t.batchTicks();
+	auto stage = [&](const char* name, uint64_t ticks, bool last) {
+		os << "    \"" << name << "\": { \"ticks_per_key\": " << (t.keys ? double(ticks) / t.keys : 0)
+			<< ", \"ns_per_key\": " << (t.keys ? 1e9 * ticks / ticksPerSecond() / t.keys : 0)
+			<< ", \"share_pct\": " << (batchTicks ? 100.0 * ticks / batchTicks : 0) << " }" << (last ? "\n" : ",\n");
+	};
+
+	os << std::setprecision(6);
+	os << "{\n";
+	os << "  \"duration_s\": " << r.seconds << ",\n";
+	os << "  \"interrupted\": " << (r.interrupted ? "true" : "false") << ",\n";
+	os << "  \"threads\": " << r.threads << ",\n";
+	os << "  \"index\": \"" << (opts.balanceFiles.empty() ? "synthetic" : "files") << "\",\n";
+	os << "  \"index_outputs\": " << addresses.size() + taprootKeys.size() << ",\n";
+	os << "  \"total_keys\": " << t.keys << ",\n";
+	os << "  \"keys_per_s\": " << (r.seconds > 0 ? t.keys / r.seconds : 0) << ",\n";
+	os << "  \"per_thread\": {\n";
+	os << "    \"keys\": [";
+	for (size_t i = 0; i < r.threadKeys.size(); i++) os << (i ? ", " : "") << r.threadKeys[i];
+	os << "],\n";
+	os << "    \"min\": " << (r.threads ? *minKeys : 0) << ", \"max\": " << (r.threads ? *maxKeys : 0)
+		<< ", \"mean\": " << mean << ", \"stddev_pct\": " << (mean > 0 ? 100 * stddev / mean : 0) << "\n";
+	os << "  },\n";
+	os << "  \"batches\": " << t.batches << ",\n";
+	os << "  \"ticks_per_s\": " << ticksPerSecond() << ",\n";
+	os << "  \"stages\": {\n";
+	for (unsigned s = 0; s < stageCount; s++) stage(stageNames[s], t.ticks[s], false);
+	stage("p2tr", t.taprootTicks, true); // Part of sha256 and ec
+	os << "  },\n";
+	os << "  \"hardware\": ";
+	if (!t.hwMask) {
+		os << "null\n"; // No --perf, or no access to the counters
+	}
+	else {
+		os << "{\n    \"ipc\": ";
+		if ((t.hwMask & (1u << HwInstructions)) && t.hw[HwCycles]) os << double(t.hw[HwInstructions]) / t.hw[HwCycles];
+		else os << "null";
+		for (unsigned c = 0; c < hwCount; c++) {
+			os << ",\n    \"" << hwNames[c] << "_per_key\": ";
+			if ((t.hwMask & (1u << c)) && t.keys) os << double(t.hw[c]) / t.keys;
+			else os << "null";
+		}
+		os << "\n  }\n";
+	}
+	os << "}\n";
+}
+
+// Read bandwidth of the whole host, threads summing their share of a buffer much larger than the caches
+double measureReadBandwidth(unsigned threads) {
+	static constexpr size_t words = size_t{ 32 } << 20; // 256 MB
+	std::vector<uint64_t> buffer(words, 1);
+	std::atomic<uint64_t> bytes{ 0 };
+	std::vector<std::thread> pool;
+	auto start = steady_clock::now();
+	for (unsigned t = 0; t < threads; t++) {
+		pool.emplace_back([&, t]() {
+			uint64_t sum = 0, read = 0;
+			size_t first = words * t / threads, last = words * (t + 1) / threads;
+			while (steady_clock::now() - start < milliseconds(500)) {
+				for (size_t i = first; i < last; i++) sum += buffer[i];
+				read += (last - first) * sizeof(uint64_t);
+			}
+			bytes += read + (sum == 0); // sum is used so the loop is kept
+		});
+	}
+	for (auto& t : pool) t.join();
+	return bytes / duration<double>(steady_clock::now() - start).count();
+}
+
+struct ScalingStep {
+	std::string series; // cores: one thread per physical core, smt: siblings filled first
+	unsigned threads = 0;
+	std::vector<unsigned> cpus = {};
+	double keysPerSec = 0;
+	double efficiency = 0; // keys/s against threads times the single thread keys/s
+	double indexBytesPerSec = 0; // Estimate from the lookup count, not measured
+};
+
+// Benchmarks 1, 2, 4... threads up to every core without SMT siblings, then up to every logical CPU with them
+// Index traffic is a model estimate, not a measurement: each hash lookup counted as two cache lines (bucket and node)
+// read from memory, an upper bound since the hot buckets stay in the caches
+std::vector<ScalingStep> runScaling(Options const& opts, double& peakBytesPerSec) {
+	auto topology = cpuTopology();
+	auto counts = [](size_t n) {
+		std::vector<unsigned> r;
+		for (unsigned k = 1; k < n; k *= 2) r.push_back(k);
+		r.push_back(static_cast<unsigned>(n));
+		return r;
+	};
+	std::vector<ScalingStep> steps;
+	for (unsigned k : counts(topology.cores.size())) {
+		ScalingStep step{ "cores", k };
+		for (unsigned c = 0; c < k && topology.known; c++) step.cpus.push_back(topology.cores[c].front());
+		steps.push_back(step);
+	}
+	if (topology.smt()) {
+		std::vector<unsigned> siblingsFirst;
+		for (auto const& core : topology.cores) siblingsFirst.insert(siblingsFirst.end(), core.begin(), core.end());
+		for (unsigned k : counts(siblingsFirst.size())) {
+			if (k == 1) continue;
+			steps.push_back({ "smt", k, std::vector<unsigned>(siblingsFirst.begin(), siblingsFirst.begin() + k) });
+		}
+	}
+
+	unsigned lookups = 0;
+	for (unsigned f : { FormatP2PKH, FormatP2WPKH, FormatP2SHP2WPKH, FormatP2PKHUncompressed, FormatP2TR }) {
+		lookups += opts.vanity.empty() && (opts.formats & f) != 0;
+	}
+	std::cout << topology.cores.size() << " core(s), " << topology.logical() << " logical CPU(s)"
+		<< (topology.known ? "" : ", topology unknown, threads are not pinned") << std::endl;
+	peakBytesPerSec = measureReadBandwidth(static_cast<unsigned>(topology.logical()));
+	std::cout << "Memory read bandwidth " << std::fixed << std::setprecision(1) << peakBytesPerSec / 1e9 << " GB/s" << std::endl;
+	std::cout << std::left << std::setw(8) << "series" << std::right << std::setw(8) << "threads" << std::setw(14) << "keys/s"
+		<< std::setw(12) << "efficiency" << std::setw(16) << "index GB/s*" << std::setw(12) << "of peak" << std::endl;
+
+	double single = 0;
+	for (auto& step : steps) {
+		Options o = opts;
+		o.threads = step.threads;
+		o.cpus = step.cpus;
+		auto report = runBench(o);
+		if (report.interrupted) break;
+		step.keysPerSec = report.totals.keys / report.seconds;
+		if (single == 0) single = step.keysPerSec;
+		step.efficiency = single > 0 ? step.keysPerSec / (single * step.threads) : 0;
+		step.indexBytesPerSec = step.keysPerSec * lookups * 2 * 64;
+		std::cout << std::left << std::setw(8) << step.series << std::right << std::setw(8) << step.threads << std::setw(14) << std::setprecision(0) << step.keysPerSec
+			<< std::setw(11) << std::setprecision(1) << 100 * step.efficiency << "%" << std::setw(16) << std::setprecision(2) << step.indexBytesPerSec / 1e9
+			<< std::setw(11) << std::setprecision(1) << 100 * step.indexBytesPerSec / peakBytesPerSec << "%" << std::endl;
+	}
+	std::cout << "* estimated, " << lookups << " lookup(s) per key of 2 cache lines, not measured" << std::endl;
+	steps.erase(std::remove_if(steps.begin(), steps.end(), [](auto const& s) { return s.keysPerSec == 0; }), steps.end());
+	return steps;
+}
+
+void writeScalingJson(std::ostream& os, std::vector<ScalingStep> const& steps, double peakBytesPerSec) {
+	os << std::setprecision(6) << "{\n  \"read_bandwidth_bytes_per_s\": " << peakBytesPerSec << ",\n  \"steps\": [\n";
+	for (size_t i = 0; i < steps.size(); i++) {
+		auto const& s = steps[i];
+		os << "    { \"series\": \"" << s.series << "\", \"threads\": " << s.threads << ", \"cpus\": [";
+		for (size_t j = 0; j < s.cpus.size(); j++) os << (j ? ", " : "") << s.cpus[j];
+		os << "], \"keys_per_s\": " << s.keysPerSec << ", \"efficiency\": " << s.efficiency
+			<< ", \"index_bytes_per_s_estimate\": " << s.indexBytesPerSec << " }" << (i + 1 < steps.size() ? "," : "") << "\n";
+	}
+	os << "  ]\n}\n";
+}
+
+// Tuned parameters of a host, kept in the profile file by host and search
+struct TuneProfile {
+	unsigned threads;
+	unsigned batchKeys;
+	unsigned lanes;
+};
+
+// The best parameters depend on the CPU and on the work of a key: formats, key source and matcher
+std::string tuneKey(Options const& opts) {
+	auto topology = cpuTopology();
+	std::string source = !opts.vanity.empty() ? "vanity" : opts.rangeScan ? "range" : "random";
+	return cpuModel() + "|" + std::to_string(topology.logical()) + " cpus|formats " + std::to_string(opts.formats) + "|" + source;
+}
+
+// One "key<TAB>threads batch lanes" line per tuned host
+std::optional<TuneProfile> loadTuneProfile(std::string const& path, std::string const& key) {
+	std::ifstream f{ path };
+	std::string line;
+	while (std::getline(f, line)) {
+		auto tab = line.find('\t');
+		if (tab == std::string::npos || line.substr(0, tab) != key) continue;
+		std::istringstream is{ line.substr(tab + 1) };
+		TuneProfile p;
+		// An invalid line is ignored, the host is tuned again and the line replaced
+		if (is >> p.threads >> p.batchKeys >> p.lanes && p.threads > 0 && p.batchKeys > 0 && p.batchKeys <= batchSize && validLanes(p.lanes)) return p;
+	}
+	return std::nullopt;
+}
+
+void saveTuneProfile(std::string const& path, std::string const& key, TuneProfile const& p) {
+	std::vector<std::string> lines;
+	{
+		std::ifstream f{ path };
+		std::string line;
+		while (std::getline(f, line)) {
+			if (line.substr(0, line.find('\t')) != key) lines.push_back(line);
+		}
+	}
+	lines.push_back(key + "\t" + std::to_string(p.threads) + " " + std::to_string(p.batchKeys) + " " + std::to_string(p.lanes));
+	std::ofstream f{ path, std::ios::trunc };
+	for (auto const& line : lines) f << line << "\n";
+	if (!f) throw std::runtime_error{ "Cannot write " + path };
+}
+
+// Short trials of the real pipeline on the loaded index, one parameter at a time from the defaults:
+// lane width, then batch length, then thread count (every logical CPU or one per physical core)
+// Libsecp256k1 fixes its own table window and inversions at build time, they are not tuned
+TuneProfile autotune(Options const& opts) {
+	static constexpr double trialSeconds = 1;
+	Options o = opts;
+	o.benchSeconds = trialSeconds;
+	o.cpus.clear();
+	if (o.mode == Options::Mode::Worker) {
+		o.mode = Options::Mode::Miner;
+		o.rangeScan = false; // No lease yet, trials use random keys
+	}
+	auto topology = cpuTopology();
+	o.threads = static_cast<unsigned>(topology.logical());
+
+	auto trial = [&o]() {
+		auto report = runBench(o);
+		if (report.interrupted) throw std::runtime_error{ "Interrupted" };
+		double speed = report.totals.keys / report.seconds;
+		std::cout << "  threads " << o.threads << ", batch " << o.batchKeys << ", lanes " << o.lanes << ": " << std::fixed << std::setprecision(0) << speed << " keys/s" << std::endl;
+		return speed;
+	};
+	auto best = [&](unsigned& param, std::vector<unsigned> const& values) {
+		unsigned bestValue = param;
+		double bestSpeed = 0;
+		for (unsigned v : values) {
+			param = v;
+			double speed = trial();
+			if (speed > bestSpeed) {
+				bestSpeed = speed;
+				bestValue = v;
+			}
+		}
+		param = bestValue;
+	};
+	best(o.lanes, { 4, 8, 16 });
+	best(o.batchKeys, { 64, 128, 256 });
+	std::vector<unsigned> threads{ o.threads };
+	if (topology.smt()) threads.push_back(static_cast<unsigned>(topology.cores.size()));
+	if (threads.size() > 1) best(o.threads, threads);
+	return { o.threads, o.batchKeys, o.lanes };
+}
+
+// Prometheus text of this process for --metrics, built from the stats page like wm-top
+// Rates are averaged over the time since the previous scrape, at least a second
+class MetricsRenderer {
+public:
+	std::string operator()() {
+		auto const& h = *statsPage.header();
+		std::vector<StatsTotals> threads;
+		StatsTotals t;
+		for (unsigned i = 0; i < std::min(h.threads.load(), h.capacity); i++) {
+			threads.push_back(statsPage.slots()[i].read());
+			t += threads.back();
+		}
+		auto now = steady_clock::now();
+		double seconds = duration<double>(now - lastAt).count();
+		if (lastKeys.size() != threads.size()) {
+			// First scrape or new run: keys over the time the thread spent in its batches
+			rates.clear();
+			for (auto const& w : threads) rates.push_back(w.batchTicks() ? w.keys * h.ticksPerSecond / w.batchTicks() : 0);
+			lastKeys.assign(threads.size(), 0);
+			seconds = 0;
+		}
+		else if (seconds < 1) {
+			seconds = -1; // Too close to the previous scrape, its rates are kept
+		}
+		for (size_t i = 0; seconds >= 0 && i < threads.size(); i++) {
+			if (seconds > 0) rates[i] = threads[i].keys >= lastKeys[i] ? (threads[i].keys - lastKeys[i]) / seconds : 0;
+			lastKeys[i] = threads[i].keys;
+		}
+		if (seconds >= 0) lastAt = now;
+		double rate = 0;
+		for (double r : rates) rate += r;
+
+		MetricsText m;
+		m.family("walletminer_info", "gauge", "Constant 1, labelled with what the process runs.");
+		m.sample("walletminer_info", 1, "mode=\"" + std::string{ h.mode, strnlen(h.mode, sizeof(h.mode)) } + "\",state=\"" + minerStateNames[std::min<uint32_t>(h.state, 2)] + "\"");
+		m.family("walletminer_start_time_seconds", "gauge", "Start time of the process since the Unix epoch.");
+		m.sample("walletminer_start_time_seconds", h.startTime / 1000.0);
+		m.family("walletminer_threads", "gauge", "Worker threads of the current run.");
+		m.sample("walletminer_threads", threads.size());
+		m.family("walletminer_keys_total", "counter", "Private keys tested.");
+		m.sample("walletminer_keys_total", t.keys);
+		m.family("walletminer_keys_per_second", "gauge", "Keys tested per second since the previous scrape.");
+		m.sample("walletminer_keys_per_second", rate);
+		m.family("walletminer_thread_keys_total", "counter", "Private keys tested by each worker thread.");
+		for (size_t i = 0; i < threads.size(); i++) m.sample("walletminer_thread_keys_total", threads[i].keys, "thread=\"" + std::to_string(i) + "\"");
+		m.family("walletminer_thread_keys_per_second", "gauge", "Keys tested per second by each worker thread since the previous scrape.");
+		for (size_t i = 0; i < threads.size(); i++) m.sample("walletminer_thread_keys_per_second", rates[i], "thread=\"" + std::to_string(i) + "\"");
+		m.family("walletminer_batches_total", "counter", "Batches processed by the workers.");
+		m.sample("walletminer_batches_total", t.batches);
+		m.family("walletminer_stage_seconds_total", "counter", "Thread time spent in each stage of the batches.");
+		for (unsigned i = 0; i < stageCount; i++) m.sample("walletminer_stage_seconds_total", t.ticks[i] / h.ticksPerSecond, "stage=\"" + std::string{ stageNames[i] } + "\"");
+		m.family("walletminer_p2tr_seconds_total", "counter", "Part of the sha256 and ec stage time spent on P2TR output keys.");
+		m.sample("walletminer_p2tr_seconds_total", t.taprootTicks / h.ticksPerSecond);
+		if (t.hwMask) {
+			m.family("walletminer_hardware_events_total", "counter", "Hardware counters of the workers, user space only (--perf).");
+			for (unsigned c = 0; c < hwCount; c++) {
+				if (t.hwMask & (1u << c)) m.sample("walletminer_hardware_events_total", t.hw[c], "event=\"" + std::string{ hwNames[c] } + "\"");
+			}
+		}
+		m.family("walletminer_index_outputs", "gauge", "Funded outputs in the index.");
+		m.sample("walletminer_index_outputs", h.indexOutputs.load());
+		m.family("walletminer_index_memory_bytes", "gauge", "Estimate of the memory held by the index.");
+		m.sample("walletminer_index_memory_bytes", h.indexBytes.load());
+		m.family("walletminer_lookups_total", "counter", "Index lookups, or vanity prefix tests.");
+		m.sample("walletminer_lookups_total", t.lookups);
+		m.family("walletminer_lookup_candidates_total", "counter", "Lookups found in the index, or passing the vanity interval filter.");
+		m.sample("walletminer_lookup_candidates_total", t.candidates);
+		m.family("walletminer_filter_false_positives_total", "counter", "Candidates of the vanity interval filter rejected by the full address check.");
+		m.sample("walletminer_filter_false_positives_total", t.falsePositives);
+		m.family("walletminer_hits_total", "counter", "Funded or vanity addresses found.");
+		m.sample("walletminer_hits_total", t.hits);
+		m.family("walletminer_loader_bytes", "gauge", "Bytes of the balance files read.");
+		m.sample("walletminer_loader_bytes", h.loaderBytes.load());
+		m.family("walletminer_loader_size_bytes", "gauge", "Total size of the balance files.");
+		m.sample("walletminer_loader_size_bytes", h.loaderSize.load());
+		m.family("walletminer_loader_rows", "gauge", "Rows of the balance files read.");
+		m.sample("walletminer_loader_rows", h.loaderRows.load());
+		return m.str();
+	}
+
+private:
+	steady_clock::time_point lastAt;
+	std::vector<uint64_t> lastKeys; // Per thread, at the previous rate update
+	std::vector<double> rates;
+};
+
+// wm-bench includes this file for the kernels and has its own main
+#ifndef WALLETMINER_NO_MAIN
+int main(int argc, char** argv) {
+
+	Options opts;
+	try {
+		opts = parseOptions(argc, argv);
+	}
+	catch (const std::exception& e) {
+		std::cout << e.what() << std::endl;
+		printUsage();
+		return 1;
+	}
+
+	try {
+		for (auto const& prefix : opts.vanity) {
+			vanityPatterns.add(prefix, opts.ignoreCase);
+		}
+		vanityPatterns.finalize();
+	}
+	catch (const std::exception& e) {
+		std::cout << e.what() << std::endl;
+		return 1;
+	}
+
+	// Check that the built address is right for the private key
+	secp256k1_context* ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+
+	// Check that prv => pub function gives the right pub key
+	assert(
+		privateKeyToAddress(
+			stringToPrvKey("be63955589062b68320f0a3d5b450551c67bbb5f6e5b34cec57738f3a96316a9"), ctx)
+		== strToArr("1Dai8FBumerEYMzijW7hfMgD45HowqYzVP")
+	);
+
+	// Check that a valid prv key is considered valid by the system
+	assert(
+		checkValidPrvKey(stringToPrvKey("be63955589062b68320f0a3d5b450551c67bbb5f6e5b34cec57738f3a96316a9"))
+	);
+
+
+	// Check that conversions work
+	assert(arrToStr(strToArr("1LruNZjwamWJXThX2Y8C2d47QqhAkkc5os")) == "1LruNZjwamWJXThX2Y8C2d47QqhAkkc5os");
+	assert(
+		prvKeyToString(
+			stringToPrvKey("be63955589062b68320f0a3d5b450551c67bbb5f6e5b34cec57738f3a96316a9")
+		) == "be63955589062b68320f0a3d5b450551c67bbb5f6e5b34cec57738f3a96316a9"
+	);
+
+	// Check that stepping a pubkey by G gives the pubkey of the next private key
+	{
+		auto prv = stringToPrvKey("be63955589062b68320f0a3d5b450551c67bbb5f6e5b34cec57738f3a96316a9");
+		secp256k1_pubkey p, g, next, expected;
+		const secp256k1_pubkey* ins[2] = { &p, &g };
+		bool ok = secp256k1_ec_pubkey_create(ctx, &p, prv.data())
+			&& secp256k1_ec_pubkey_create(ctx, &g, u256FromU64(1).data())
+			&& secp256k1_ec_pubkey_create(ctx, &expected, u256AddU64(prv, 1).data())
+			&& secp256k1_ec_pubkey_combine(ctx, &next, ins, 2);
+		assert(ok && secp256k1_ec_pubkey_cmp(ctx, &next, &expected) == 0);
+	}
+
+	// Check the sha256 lane kernels against openssl on both pubkey sizes, with a partial last group
+	{
+		secp256k1_pubkey p;
+		bool ok = secp256k1_ec_pubkey_create(ctx, &p, stringToPrvKey("be63955589062b68320f0a3d5b450551c67bbb5f6e5b34cec57738f3a96316a9").data());
+		assert(ok);
+		uint8_t keys[hashLanes + 1][33], full[hashLanes + 1][65];
+		for (size_t i = 0; i <= hashLanes; i++) {
+			size_t len = 33;
+			secp256k1_ec_pubkey_serialize(ctx, keys[i], &len, &p, SECP256K1_EC_COMPRESSED);
+			len = 65;
+			secp256k1_ec_pubkey_serialize(ctx, full[i], &len, &p, SECP256K1_EC_UNCOMPRESSED);
+			keys[i][1 + i] ^= 0x5a; // A different message per lane
+			full[i][64 - i] ^= 0x5a;
+		}
+		for (unsigned lanes : { 4, 8, 16 }) {
+			std::array<uint8_t, 20> h33[hashLanes + 1], h65[hashLanes + 1];
+			hash160Lanes(keys, hashLanes + 1, h33, lanes);
+			hash160Lanes(full, hashLanes + 1, h65, lanes);
+			for (size_t i = 0; i <= hashLanes; i++) {
+				std::array<uint8_t, 20> expected;
+				ripemd160(sha256(keys[i], 33).data(), 32, expected.data());
+				assert(h33[i] == expected);
+				ripemd160(sha256(full[i], 65).data(), 32, expected.data());
+				assert(h65[i] == expected);
+			}
+		}
+		assert(encodeAddress({ AddressType::P2PKH, pubkeyToHash160(p, ctx, SECP256K1_EC_UNCOMPRESSED) }) == "18pRzZBpMyrfPbcBBQcfVYMXoibm6fhqYs");
+	}
+
+	// Check the batched P2TR stage and the reference derivation against the BIP86 example
+	{
+		auto prv = stringToPrvKey("41f41d69260df4cf277826a9b65a3717e4eeddbeedf637f212ca096576479361");
+		auto b = std::make_unique<Batch>();
+		Options o;
+		o.formats = FormatP2TR;
+		WorkerStats stats;
+		WorkerContext wc{ o, ctx, 0, nullptr, stats };
+		auto stage = std::make_unique<TaprootStage>(wc);
+		uint8_t keys[hashLanes + 1][33];
+		for (size_t i = 0; i <= hashLanes; i++) {
+			size_t len = 33;
+			bool ok = secp256k1_ec_pubkey_create(ctx, &b->pub[i], u256AddU64(prv, i).data());
+			ok = ok && secp256k1_ec_pubkey_serialize(ctx, keys[i], &len, &b->pub[i], SECP256K1_EC_COMPRESSED);
+			assert(ok);
+		}
+		stage->run(*b, keys, hashLanes + 1);
+		assert(encodeAddress(b->taprootKey[0]) == "bc1p5cyxnuxmeuwuvkwfem96lqzszd02n6xdcjrs20cac6yqjjwudpxqkedrcr");
+		for (size_t i = 0; i <= hashLanes; i++) {
+			assert(taprootOutputKey(b->pub[i], ctx) == b->taprootKey[i]);
+		}
+	}
+
+	// Check 256 bits helpers
+	assert(u256ToHex(u256FromHex("0x1ff")) == std::string(61, '0') + "1ff");
+	assert(u256Cmp(u256Sub(u256FromU64(0x100), u256FromU64(1)), u256FromU64(0xff)) == 0);
+
+	// Check that a vanity prefix covers the hash160 of an address starting with it, and only those
+	{
+		VanityPatterns p;
+		p.add("1Dai");
+		p.finalize();
+		auto decoded = base58Decode("1Dai8FBumerEYMzijW7hfMgD45HowqYzVP");
+		Hash160 h;
+		std::copy_n(decoded.begin() + 1, 20, h.begin());
+		assert(p.contains(h));
+		h[0] ^= 0x80;
+		assert(!p.contains(h));
+	}
+
+	// Check that a random walk hands out at most one key, far from the other ones: every key matches "1" here
+	{
+		VanityPatterns every;
+		every.add("1");
+		every.finalize();
+		std::swap(vanityPatterns, every);
+		Options o;
+		o.vanity = { "1" };
+		WorkerStats stats;
+		WorkerContext wc{ o, ctx, 0, nullptr, stats };
+		struct Collect {
+			void report(std::array<uint8_t, 32> const& prv, std::string const&, uint64_t, Network = Network::Bitcoin) { keys.push_back(prv); }
+			std::vector<u256> keys;
+		} collect;
+		auto source = std::make_unique<RandomWalkKeySource>(wc);
+		auto deriver = std::make_unique<CompressedDeriver>(wc);
+		VanityMatcher matcher{ wc };
+		auto b = std::make_unique<Batch>();
+		for (int i = 0; i < 4; i++) {
+			size_t n = source->fill(*b);
+			deriver->derive(*b, n);
+			matcher.match(*b, n, collect);
+		}
+		assert(collect.keys.size() == 4);
+		assert(wc.counts.candidates == wc.counts.hits + wc.counts.falsePositives);
+
+		// A range scan reports every key of the range, a hit does not end anything
+		RangeJob job{ u256FromU64(1), u256FromU64(1000), 1, false };
+		WorkerContext rc{ o, ctx, 0, &job, stats };
+		Collect all;
+		{
+			RangeKeySource range{ rc };
+			VanityMatcher rangeMatcher{ rc };
+			while (size_t n = range.fill(*b)) {
+				deriver->derive(*b, n);
+				rangeMatcher.match(*b, n, all);
+			}
+		}
+		std::swap(vanityPatterns, every);
+		assert(all.keys.size() == 1000 && job.idle());
+		for (size_t i = 0; i < collect.keys.size(); i++) {
+			for (size_t j = i + 1; j < collect.keys.size(); j++) {
+				auto const& x = collect.keys[i];
+				auto const& y = collect.keys[j];
+				assert(u256Cmp(u256Cmp(x, y) < 0 ? u256Sub(y, x) : u256Sub(x, y), u256FromU64(uint64_t{ 1 } << 32)) > 0);
+			}
+		}
+	}
+
+	// Check the P2WPKH encoding against the BIP173 example, and a bc1q prefix against its own hash160
+	{
+		auto wide = u256FromHex("751e76e8199196d454941c45d1b3a323f1433bd6");
+		Hash160 h;
+		std::copy_n(wide.begin() + 12, 20, h.begin());
+		assert(segwitAddress("bc", 0, h.data(), h.size()) == "bc1qw508d6qejxtdg4y5r3zarvary0c5xw7kv8f3t4");
+		VanityPatterns p;
+		p.add("bc1qw508d6");
+		p.finalize();
+		uint8_t hit[2];
+		Hash160 hs[2] = { h, h };
+		hs[1][3] ^= 0x04; // Last bit spelled by the prefix
+		p.matchSegwit(hs, 2, hit);
+		assert(hit[0] == 1 && hit[1] == 0);
+	}
+
+	// Check the bech32m decoding of a P2TR address against the BIP350 example, and that checksum or case errors are rejected
+	{
+		auto key = decodeAddress("bc1p0xlxvlhemja6c4dqv22uapctqupfhlxm9h8z3k2e72q4k9hcz7vqzk5jj0");
+		assert(key && std::holds_alternative<XOnlyKey>(*key));
+		assert(u256ToHex(std::get<XOnlyKey>(*key)) == "79be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798");
+		assert(encodeAddress(std::get<XOnlyKey>(*key)) == "bc1p0xlxvlhemja6c4dqv22uapctqupfhlxm9h8z3k2e72q4k9hcz7vqzk5jj0");
+		assert(decodeAddress("BC1P0XLXVLHEMJA6C4DQV22UAPCTQUPFHLXM9H8Z3K2E72Q4K9HCZ7VQZK5JJ0"));
+		assert(!decodeAddress("bc1p0xlxvlhemja6c4dqv22uapctqupfhlxm9h8z3k2e72q4k9hcz7vqzk5jj1"));
+		assert(!decodeAddress("bc1p0xlxvlhemja6c4dqv22uapctqupfhlxm9h8z3k2e72q4k9hcz7vqzk5jJ0"));
+		assert(!decodeAddress("bc1zw508d6qejxtdg4y5r3zarvaryvqyzf3du")); // BIP350: version 2 with a bech32 checksum
+	}
+
+	secp256k1_context_destroy(ctx);
+
+	std::signal(SIGINT, onStopSignal);
+	std::signal(SIGTERM, onStopSignal);
+
+	if (opts.mode == Options::Mode::Coordinator) {
+		return runCoordinator(opts);
+	}
+
+	// Shared before the index is loaded, so wm-top and /metrics show the process from the start
+	createStatsPage(opts);
+	statsPage.header()->vanityProbability = vanityPatterns.empty() ? 0 : vanityPatterns.probability();
+	for (auto const& [network, file] : opts.balanceFiles) {
+		std::error_code ec;
+		auto size = std::filesystem::file_size(file, ec);
+		if (!ec) statsPage.header()->loaderSize += size;
+	}
+	std::unique_ptr<MetricsServer> metricsServer;
+	if (!opts.metrics.empty()) {
+		try {
+			auto address = MetricsServer::address(opts.metrics);
+			metricsServer = std::make_unique<MetricsServer>(address, MetricsRenderer{});
+			std::cout << "Metrics on http://" << address << "/metrics" << std::endl;
+		}
+		catch (const std::exception& e) {
+			std::cout << e.what() << std::endl;
+			return 2;
+		}
+	}
+
+	std::unique_ptr<RangeJob> range;
+	if (opts.mode == Options::Mode::Worker) {
+		range = std::make_unique<RangeJob>(opts.threads); // Fed by the coordinator
+	}
+	else if (opts.rangeScan && !opts.bench) {
+		try {
+			auto cp = loadCheckpoint(opts.checkpointFile);
+			if (!cp) {
+				range = std::make_unique<RangeJob>(opts.start, opts.end, opts.threads, opts.interleave);
+			}
+			else if (u256Cmp(cp->start, opts.start) != 0 || u256Cmp(cp->end, opts.end) != 0 || cp->interleave != opts.interleave) {
+				std::cout << "Checkpoint " << opts.checkpointFile << " belongs to another range scan" << std::endl;
+				return 3;
+			}
+			else if (cp->state.pending.empty() && cp->state.inflight.empty()) {
+				std::cout << "Range already complete according to " << opts.checkpointFile << std::endl;
+				return 0;
+			}
+			else {
+				range = std::make_unique<RangeJob>(cp->state, opts.threads);
+				std::cout << "Resuming from " << opts.checkpointFile << std::endl;
+			}
+		}
+		catch (const std::exception& e) {
+			std::cout << e.what() << std::endl;
+			return 3;
+		}
+		std::cout << "Scanning range " << u256ToHex(opts.start) << " - " << u256ToHex(opts.end) << std::endl;
+	}
+
+	auto saveRange = [&opts, &range]() {
+		try {
+			saveCheckpoint(opts.checkpointFile, Checkpoint{ opts.start, opts.end, opts.interleave, range->snapshot() });
+		}
+		catch (const std::exception& e) {
+			std::cout << std::endl << e.what() << std::endl;
+		}
+	};
+
+	double vanityProbability = vanityPatterns.probability();
+	if (!vanityPatterns.empty()) {
+		std::cout << "Searching " << vanityPatterns.patterns().size() << " vanity prefix(es) in " << vanityPatterns.intervalCount() << " hash160 intervals, difficulty " << 1 / vanityProbability
+			<< ", 50% chance after " << std::log(2) / vanityProbability << " keys" << std::endl;
+	}
+	else {
+		try {
+			for (auto const& [network, file] : opts.balanceFiles) {
+				loadValidAddresses(file.c_str(), network, opts.threads);
+			}
+			if (opts.bench && opts.balanceFiles.empty()) {
+				loadSyntheticIndex(opts.benchIndex);
+			}
+#ifndef NDEBUG
+			testDistribution();
+#endif // DEBUG
+
+
+		}
+		catch (const std::exception& e) {
+			std::cout << "Error loading file" << std::endl;
+			std::cout << e.what() << std::endl;
+			return 2;
+		}
+
+		// Using a random pub key in the bitcoin file to see if it finds it in addresses
+		assert(std::none_of(opts.balanceFiles.begin(), opts.balanceFiles.end(), [](auto const& f) { return f.first == Network::Bitcoin; })
+			|| checkAddress("1LruNZjwamWJXThX2Y8C2d47QqhAkkc5os").has_value());
+		statsPage.header()->indexOutputs = addresses.size() + taprootKeys.size();
+		statsPage.header()->indexBytes = indexMemory();
+	}
+	
+	try {
+		hitReporter.start(opts);
+	}
+	catch (const std::exception& e) {
+		std::cout << e.what() << std::endl;
+		return 2;
+	}
+
+	if (opts.autotune) {
+		std::string path = std::filesystem::current_path().string() + "/walletminer.tune.txt";
+		auto key = tuneKey(opts);
+		auto profile = opts.retune ? std::nullopt : loadTuneProfile(path, key);
+		try {
+			if (profile) {
+				std::cout << "Tuning of this host read from " << path << std::endl;
+			}
+			else {
+				std::cout << "Tuning for " << key << std::endl;
+				profile = autotune(opts);
+				saveTuneProfile(path, key, *profile);
+			}
+		}
+		catch (const std::exception& e) {
+			std::cout << e.what() << std::endl;
+			hitReporter.stop();
+			return 2;
+		}
+		opts.threads = profile->threads;
+		opts.batchKeys = profile->batchKeys;
+		opts.lanes = profile->lanes;
+		std::cout << "Using " << opts.threads << " thread(s), batches of " << opts.batchKeys << " keys, " << opts.lanes << " hash lanes" << std::endl;
+	}
+
+	if (opts.scaling) {
+		double peak = 0;
+		auto steps = runScaling(opts, peak);
+		hitReporter.stop();
+		if (!opts.jsonFile.empty()) {
+			std::ofstream f{ opts.jsonFile };
+			writeScalingJson(f, steps, peak);
+			if (!f) {
+				std::cout << "Cannot write " << opts.jsonFile << std::endl;
+				return 2;
+			}
+		}
+		return 0;
+	}
+	if (opts.bench) {
+		std::cout << "Benchmarking " << opts.threads << " thread(s) for " << formatDuration(opts.benchSeconds) << std::endl;
+		auto report = runBench(opts);
+		hitReporter.stop();
+		writeBenchJson(std::cout, report, opts);
+		if (!opts.jsonFile.empty()) {
+			std::ofstream f{ opts.jsonFile };
+			writeBenchJson(f, report, opts);
+			if (!f) {
+				std::cout << "Cannot write " << opts.jsonFile << std::endl;
+				return 2;
+			}
+		}
+		return 0;
+	}
+
+	resetWorkerStats(opts);
+	Pipeline::Fn pipeline = selectPipeline(opts);
+	unsigned int _maxThreads = opts.threads;
+	std::vector<std::thread> threads;
+	runningWorkers = _maxThreads;
+	for (unsigned int i = 0; i < _maxThreads; i++) {
+		threads.emplace_back(
+			std::thread{ [&opts, i, pipeline, &range]() {
+				try {
+					check(opts, i, pipeline, range.get());
+					runningWorkers--;
+				}
+				catch (const std::exception& e) {
+					std::cout << e.what() << std::endl;
+					exit(1);
+				}
+			}} 
+		);
+	}
+
+	bool remoteOk = true;
+	std::thread client;
+	if (opts.mode == Options::Mode::Worker) {
+		client = std::thread{ [&opts, &range, &remoteOk]() {
+			remoteOk = remoteClient(opts, *range);
+		} };
+	}
+
+	// Speed, stages and hit rates are read from the stats page by wm-top, this thread only saves the progress
+	std::cout << "Running, live stats with wm-top (process " << StatsPage::currentPid() << ")" << std::endl;
+	bool saveProgress = range && opts.mode == Options::Mode::Miner;
+	auto lastCheckpoint = steady_clock::now();
+	while (runningWorkers > 0) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		if (saveProgress && steady_clock::now() - lastCheckpoint >= seconds(opts.checkpointInterval)) {
+			saveRange();
+			lastCheckpoint = steady_clock::now();
+		}
+	}
+
+	for (auto& t : threads) {
+		t.join();
+	}
+	if (client.joinable()) {
+		client.join();
+	}
+	hitReporter.stop();
+	statsPage.header()->state = static_cast<uint32_t>(MinerState::Done);
+	if (saveProgress) {
+		saveRange(); // Final position, or the whole range marked completed
+	}
+	if (!remoteOk) {
+		return 4;
+	}
+	if (stopRequested) {
+		std::cout << "Stopped" << (saveProgress ? ", progress saved to " + opts.checkpointFile : "") << std::endl;
+	}
+	else {
+		std::cout << "Range scan complete" << std::endl;
 	}
 
 	return 0;
 }
+#endif // WALLETMINER_NO_MAIN
@@ -0,0 +1,102 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Logical CPUs grouped by physical core, SMT siblings together, cores in the order of their first CPU
+// Without topology information every logical CPU is its own core and cpus are left empty, threads are not pinned
+struct CpuTopology {
+	std::vector<std::vector<unsigned>> cores;
+	bool known = false;
+
+	size_t logical() const {
+		size_t n = 0;
+		for (auto const& c : cores) n += c.size();
+		return n;
+	}
+	bool smt() const {
+		return std::any_of(cores.begin(), cores.end(), [](auto const& c) { return c.size() > 1; });
+	}
+};
+
+inline CpuTopology cpuTopology() {
+	CpuTopology t;
+#ifdef _WIN32
+	DWORD size = 0;
+	GetLogicalProcessorInformation(nullptr, &size);
+	std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(size / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+	if (!info.empty() && GetLogicalProcessorInformation(info.data(), &size)) {
+		for (auto const& i : info) {
+			if (i.Relationship != RelationProcessorCore) continue;
+			std::vector<unsigned> core;
+			for (unsigned cpu = 0; cpu < sizeof(ULONG_PTR) * 8; cpu++) {
+				if (i.ProcessorMask & (ULONG_PTR{ 1 } << cpu)) core.push_back(cpu);
+			}
+			if (!core.empty()) t.cores.push_back(core);
+		}
+		t.known = !t.cores.empty();
+	}
+#elif defined(__linux__)
+	// Only the CPUs the process may run on
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+		std::map<std::pair<int, int>, std::vector<unsigned>> byCore; // (package, core id)
+		for (unsigned cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+			if (!CPU_ISSET(cpu, &allowed)) continue;
+			std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+			std::ifstream package{ dir + "physical_package_id" }, core{ dir + "core_id" };
+			int p = 0, c = int(cpu);
+			if (package >> p && core >> c) t.known = true;
+			byCore[{ p, c }].push_back(cpu);
+		}
+		for (auto& [id, cpus] : byCore) t.cores.push_back(cpus);
+		std::sort(t.cores.begin(), t.cores.end());
+	}
+#endif
+	if (t.cores.empty()) {
+		for (unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); cpu++) t.cores.push_back({ cpu });
+	}
+	return t;
+}
+
+// Pins the calling thread to a logical CPU, false where it is not supported
+inline bool pinThread(unsigned cpu) {
+#ifdef _WIN32
+	return cpu < sizeof(DWORD_PTR) * 8 && SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR{ 1 } << cpu) != 0;
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+	(void)cpu;
+	return false;
+#endif
+}
+
+// Model name of the CPU, "unknown" where it cannot be read
+inline std::string cpuModel() {
+#ifdef _WIN32
+	if (const char* id = std::getenv("PROCESSOR_IDENTIFIER")) return id;
+#elif defined(__linux__)
+	std::ifstream info{ "/proc/cpuinfo" };
+	for (std::string line; std::getline(info, line);) {
+		auto colon = line.find(':');
+		if (line.rfind("model name", 0) == 0 && colon != std::string::npos && colon + 2 <= line.size()) return line.substr(colon + 2);
+	}
+#endif
+	return "unknown";
+}
@@ -0,0 +1,152 @@
+﻿#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Bech32 (BIP173) and bech32m (BIP350) encoding of segwit addresses
+inline constexpr char bech32Charset[] = "qpzry9x8gf2tvdw0s3jn54khce6mua7l";
+
+inline constexpr uint32_t bech32Constant = 1;
+inline constexpr uint32_t bech32mConstant = 0x2bc830a3;
+
+// Reverse of the charset, -1 outside of it (lower case only)
+inline constexpr std::array<int8_t, 128> bech32Values = [] {
+	std::array<int8_t, 128> r{};
+	r.fill(-1);
+	for (int i = 0; i < 32; i++) r[static_cast<uint8_t>(bech32Charset[i])] = static_cast<int8_t>(i);
+	return r;
+}();
+
+// 5 bits value of a bech32 character, -1 if not part of the charset (lower case only)
+inline int bech32Value(char c) {
+	return static_cast<unsigned char>(c) < 128 ? bech32Values[static_cast<unsigned char>(c)] : -1;
+}
+
+// Feeds one 5 bits value to the checksum
+inline uint32_t bech32PolymodStep(uint32_t chk, uint8_t v) {
+	static constexpr uint32_t gen[5] = { 0x3b6a57b2, 0x26508e6d, 0x1ea119fa, 0x3d4233dd, 0x2a1462b3 };
+	uint8_t top = static_cast<uint8_t>(chk >> 25);
+	chk = ((chk & 0x1ffffff) << 5) ^ v;
+	for (int i = 0; i < 5; i++) {
+		if ((top >> i) & 1) chk ^= gen[i];
+	}
+	return chk;
+}
+
+inline uint32_t bech32Polymod(std::vector<uint8_t> const& values) {
+	uint32_t chk = 1;
+	for (uint8_t v : values) chk = bech32PolymodStep(chk, v);
+	return chk;
+}
+
+inline std::vector<uint8_t> bech32HrpExpand(std::string const& hrp) {
+	std::vector<uint8_t> r;
+	for (char c : hrp) r.push_back(static_cast<uint8_t>(c) >> 5);
+	r.push_back(0);
+	for (char c : hrp) r.push_back(static_cast<uint8_t>(c) & 31);
+	return r;
+}
+
+// Regroups bits, 8 to 5 pads the last group with zeros, 5 to 8 rejects non zero padding
+inline bool convertBits(std::vector<uint8_t>& out, uint8_t const* in, size_t len, int from, int to, bool pad) {
+	uint32_t acc = 0;
+	int bits = 0;
+	const uint32_t maxv = (1u << to) - 1;
+	for (size_t i = 0; i < len; i++) {
+		if (in[i] >> from) return false;
+		acc = (acc << from) | in[i];
+		bits += from;
+		while (bits >= to) {
+			bits -= to;
+			out.push_back(static_cast<uint8_t>((acc >> bits) & maxv));
+		}
+	}
+	if (pad) {
+		if (bits) out.push_back(static_cast<uint8_t>((acc << (to - bits)) & maxv));
+	}
+	else if (bits >= from || ((acc << (to - bits)) & maxv)) {
+		return false;
+	}
+	return true;
+}
+
+// hrp + "1" + data + 6 checksum characters, version 0 uses bech32 and later versions bech32m
+inline std::string segwitAddress(std::string const& hrp, int version, uint8_t const* program, size_t len) {
+	std::vector<uint8_t> data{ static_cast<uint8_t>(version) };
+	convertBits(data, program, len, 8, 5, true);
+
+	std::vector<uint8_t> values = bech32HrpExpand(hrp);
+	values.insert(values.end(), data.begin(), data.end());
+	values.insert(values.end(), 6, 0);
+	uint32_t mod = bech32Polymod(values) ^ (version == 0 ? bech32Constant : bech32mConstant);
+
+	std::string r = hrp + '1';
+	for (uint8_t d : data) r += bech32Charset[d];
+	for (int i = 0; i < 6; i++) r += bech32Charset[(mod >> (5 * (5 - i))) & 31];
+	return r;
+}
+
+// Witness version and program of a segwit address
+struct SegwitProgram {
+	int version;
+	size_t size;
+	std::array<uint8_t, 40> program;
+};
+
+// Checks the hrp, the character set, the case and the bech32 / bech32m checksum matching the version
+// Single pass without allocation, the loader runs it on every bc1 row of the dump
+inline std::optional<SegwitProgram> segwitDecode(std::string_view hrp, std::string_view address) {
+	size_t sep = address.rfind('1');
+	if (address.size() > 90 || sep != hrp.size() || address.size() - sep < 8) return std::nullopt;
+
+	bool lower = false, upper = false;
+	auto fold = [&](char c) {
+		if (c >= 'a' && c <= 'z') lower = true;
+		if (c >= 'A' && c <= 'Z') {
+			upper = true;
+			c = static_cast<char>(c - 'A' + 'a');
+		}
+		return c;
+	};
+	uint32_t chk = 1;
+	for (size_t i = 0; i < sep; i++) {
+		if (fold(address[i]) != hrp[i]) return std::nullopt;
+		chk = bech32PolymodStep(chk, static_cast<uint8_t>(hrp[i]) >> 5);
+	}
+	chk = bech32PolymodStep(chk, 0);
+	for (char c : hrp) chk = bech32PolymodStep(chk, static_cast<uint8_t>(c) & 31);
+
+	SegwitProgram r{ -1, 0, {} };
+	size_t dataEnd = address.size() - 6; // Checksum characters
+	uint32_t acc = 0;
+	int bits = 0;
+	for (size_t i = sep + 1; i < address.size(); i++) {
+		int v = bech32Value(fold(address[i]));
+		if (v < 0) return std::nullopt;
+		chk = bech32PolymodStep(chk, static_cast<uint8_t>(v));
+		if (i >= dataEnd) continue;
+		if (r.version < 0) {
+			r.version = v;
+			continue;
+		}
+		// 5 to 8 bits regrouping of the program
+		acc = (acc << 5) | static_cast<uint32_t>(v);
+		bits += 5;
+		if (bits >= 8) {
+			bits -= 8;
+			if (r.size == r.program.size()) return std::nullopt;
+			r.program[r.size++] = static_cast<uint8_t>(acc >> bits);
+		}
+	}
+	// Padding of at most 4 zero bits
+	if (lower && upper) return std::nullopt;
+	if (bits >= 5 || (acc & ((1u << bits) - 1))) return std::nullopt;
+	if (r.version > 16 || chk != (r.version == 0 ? bech32Constant : bech32mConstant)) return std::nullopt;
+	if (r.size < 2 || (r.version == 0 && r.size != 20 && r.size != 32)) return std::nullopt;
+	return r;
+}
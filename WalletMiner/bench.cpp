@@ -0,0 +1,590 @@
+﻿// wm-bench: microbenchmarks of the hot kernels of WMiner
+// Built from the same sources, WalletMiner.cpp is included without its main()
+#define WALLETMINER_NO_MAIN
+#include "WalletMiner.cpp"
+
+namespace bench {
+
+// Time stamp counter, reference cycles at the nominal frequency, 0 where there is none
+inline uint64_t readCycles() {
+#ifdef WM_HAS_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+// Results are folded in here so the compiler cannot drop the measured work
+static volatile uint64_t sink;
+
+struct Result {
+	std::string name;
+	uint64_t ops;
+	double nsPerOp;
+	double opsPerSec;
+	double cyclesPerOp; // NaN without a cycle counter
+};
+
+// Runs fn(n), n doubling until one run lasts minSeconds, and returns the figures of that run
+// fn does n operations and returns a value depending on all of them
+template<typename Fn>
+Result measure(std::string const& name, double minSeconds, Fn&& fn) {
+	sink = sink + fn(1); // Warm up caches and lazy tables
+	for (uint64_t n = 1;; n *= 2) {
+		auto start = std::chrono::steady_clock::now();
+		uint64_t c0 = readCycles();
+		sink = sink + fn(n);
+		uint64_t c1 = readCycles();
+		double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (secs >= minSeconds || n >= (uint64_t{ 1 } << 40)) {
+			double cycles = c1 > c0 ? double(c1 - c0) / n : std::nan("");
+			return { name, n, secs * 1e9 / n, n / secs, cycles };
+		}
+	}
+}
+
+struct Config {
+	double minSeconds = 0.5;
+	size_t indexSize = 1'000'000; // Synthetic addresses for the lookups and the end to end run
+	std::string filter; // Only benchmarks whose name contains it
+	std::string jsonFile;
+	unsigned repeat = 1; // Runs of the suite, 5 by default with --compare
+	double e2eSeconds = 3; // Duration of the end to end run, 0 to skip it
+	unsigned threads = std::thread::hardware_concurrency(); // Workers of the end to end run
+	std::string compareFile; // Baseline to compare with
+	double threshold = 5; // Slowdown in percent flagged as a regression
+};
+
+// Median of a metric over the runs and its confidence interval
+// The interval is [x(j), x(n-1-j)] of the sorted samples, which holds the true median unless j or less samples fall below it
+// (a binomial tail), j is the largest keeping a 95% level, 5 runs only give [min, max] at 93.75%
+struct Summary {
+	std::string name;
+	std::string unit; // ns_per_op or keys_per_s
+	bool higherIsBetter = false;
+	std::vector<double> samples;
+	double median = 0;
+	double low = 0;
+	double high = 0;
+	double level = 0;
+	double cyclesPerOp = std::nan(""); // Median, kernels only
+
+	void finalize() {
+		auto v = samples;
+		std::sort(v.begin(), v.end());
+		size_t n = v.size();
+		median = n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+		// P(B <= j) for B ~ Binomial(n, 1/2)
+		double tail = 0, choose = 1;
+		size_t j = 0;
+		level = 0;
+		for (size_t k = 0; 2 * k + 1 < n; k++) {
+			if (k > 0) choose = choose * (n - k + 1) / k;
+			tail += choose / std::pow(2.0, double(n));
+			if (k > 0 && 1 - 2 * tail < 0.95) break;
+			j = k;
+			level = 1 - 2 * tail;
+		}
+		low = v[j];
+		high = v[n - 1 - j];
+	}
+};
+
+static double medianOf(std::vector<double> v) {
+	std::sort(v.begin(), v.end());
+	return v.empty() ? std::nan("") : v.size() % 2 ? v[v.size() / 2] : (v[v.size() / 2 - 1] + v[v.size() / 2]) / 2;
+}
+
+// Deterministic pseudo random bytes, the benchmarks must not depend on the OS entropy source
+struct Bytes {
+	std::mt19937_64 rng{ 42 };
+
+	template<size_t N>
+	std::array<uint8_t, N> next() {
+		std::array<uint8_t, N> r;
+		for (size_t i = 0; i < N; i += 8) {
+			uint64_t v = rng();
+			std::memcpy(r.data() + i, &v, std::min<size_t>(8, N - i));
+		}
+		return r;
+	}
+};
+
+std::vector<Result> runKernels(Config const& cfg) {
+	std::vector<Result> results;
+	auto selected = [&](std::string const& name) { return cfg.filter.empty() || name.find(cfg.filter) != std::string::npos; };
+	auto add = [&](std::string const& name, auto&& fn) {
+		if (!selected(name)) return;
+		results.push_back(measure(name, cfg.minSeconds, fn));
+		auto const& r = results.back();
+		std::cout << std::left << std::setw(28) << r.name << std::right << std::fixed << std::setprecision(1)
+			<< std::setw(12) << r.nsPerOp << " ns/op" << std::setw(14) << std::setprecision(0) << r.opsPerSec << " ops/s";
+		if (!std::isnan(r.cyclesPerOp)) std::cout << std::setw(12) << std::setprecision(1) << r.cyclesPerOp << " cycles/op";
+		std::cout << std::endl;
+	};
+
+	secp256k1_context* ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+	Bytes bytes;
+	auto prv = stringToPrvKey("be63955589062b68320f0a3d5b450551c67bbb5f6e5b34cec57738f3a96316a9");
+	secp256k1_pubkey pub, g;
+	if (!secp256k1_ec_pubkey_create(ctx, &pub, prv.data()) || !secp256k1_ec_pubkey_create(ctx, &g, u256FromU64(1).data())) {
+		throw std::runtime_error{ "Cannot make pubkey" };
+	}
+
+	// 256 serialized keys, as a batch of the pipeline
+	std::vector<std::array<uint8_t, 33>> keys33(batchSize);
+	std::vector<std::array<uint8_t, 65>> keys65(batchSize);
+	for (size_t i = 0; i < batchSize; i++) {
+		secp256k1_pubkey p;
+		if (!secp256k1_ec_pubkey_create(ctx, &p, u256AddU64(prv, i).data())) throw std::runtime_error{ "Cannot make pubkey" };
+		size_t len = 33;
+		secp256k1_ec_pubkey_serialize(ctx, keys33[i].data(), &len, &p, SECP256K1_EC_COMPRESSED);
+		len = 65;
+		secp256k1_ec_pubkey_serialize(ctx, keys65[i].data(), &len, &p, SECP256K1_EC_UNCOMPRESSED);
+	}
+
+	add("generateRandomPrvKey", [&](uint64_t n) {
+		uint64_t acc = 0;
+		for (uint64_t i = 0; i < n; i++) acc += generateRandomPrvKey(true)[0];
+		return acc;
+	});
+
+	add("secp256k1_ec_pubkey_create", [&](uint64_t n) {
+		uint64_t acc = 0;
+		auto k = prv;
+		for (uint64_t i = 0; i < n; i++) {
+			secp256k1_pubkey p;
+			k[31] = static_cast<uint8_t>(i);
+			acc += secp256k1_ec_pubkey_create(ctx, &p, k.data());
+			acc += p.data[0];
+		}
+		return acc;
+	});
+
+	// What the range and random walk sources do per key
+	add("pubkey_step_combine", [&](uint64_t n) {
+		secp256k1_pubkey p = pub, next;
+		for (uint64_t i = 0; i < n; i++) {
+			const secp256k1_pubkey* ins[2] = { &p, &g };
+			if (!secp256k1_ec_pubkey_combine(ctx, &next, ins, 2)) break;
+			p = next;
+		}
+		return uint64_t{ p.data[0] };
+	});
+
+	add("pubkey_serialize_33", [&](uint64_t n) {
+		uint64_t acc = 0;
+		uint8_t out[33];
+		for (uint64_t i = 0; i < n; i++) {
+			size_t len = 33;
+			secp256k1_ec_pubkey_serialize(ctx, out, &len, &pub, SECP256K1_EC_COMPRESSED);
+			acc += out[i % 33];
+		}
+		return acc;
+	});
+
+	add("sha256_33_openssl", [&](uint64_t n) {
+		uint64_t acc = 0;
+		for (uint64_t i = 0; i < n; i++) acc += sha256(keys33[i % batchSize].data(), 33)[0];
+		return acc;
+	});
+
+	// Per key figures of the lane kernels, keys are hashed hashLanes at a time
+	auto lanes = [&](auto const& keys, auto kernel) {
+		return [&, kernel](uint64_t n) {
+			uint64_t acc = 0;
+			uint8_t sha[hashLanes][32];
+			uint8_t* out[hashLanes];
+			const uint8_t* in[hashLanes];
+			for (size_t l = 0; l < hashLanes; l++) out[l] = sha[l];
+			for (uint64_t i = 0; i < n; i += hashLanes) {
+				for (size_t l = 0; l < hashLanes; l++) in[l] = keys[(i + l) % batchSize].data();
+				kernel(in, out);
+				acc += sha[0][0];
+			}
+			return acc;
+		};
+	};
+	add("sha256_33_lanes", lanes(keys33, [](const uint8_t* const* in, uint8_t* const* out) { sha256k::sha256Lanes<33, hashLanes>(in, out); }));
+	add("sha256_65_lanes", lanes(keys65, [](const uint8_t* const* in, uint8_t* const* out) { sha256k::sha256Lanes<65, hashLanes>(in, out); }));
+
+	add("ripemd160_32", [&](uint64_t n) {
+		uint64_t acc = 0;
+		uint8_t out[20];
+		for (uint64_t i = 0; i < n; i++) {
+			ripemd160(keys33[i % batchSize].data(), 32, out);
+			acc += out[0];
+		}
+		return acc;
+	});
+
+	add("hash160_33_batch", [&](uint64_t n) {
+		std::vector<std::array<uint8_t, 20>> out(batchSize);
+		auto keys = reinterpret_cast<uint8_t const(*)[33]>(keys33.data());
+		uint64_t acc = 0;
+		for (uint64_t i = 0; i < n; i += batchSize) {
+			hash160Lanes(keys, batchSize, out.data());
+			acc += out[0][0];
+		}
+		return acc;
+	});
+
+	std::vector<std::array<uint8_t, 25>> raw(batchSize);
+	std::vector<std::string> encoded(batchSize);
+	for (size_t i = 0; i < batchSize; i++) {
+		auto h = bytes.next<20>();
+		std::copy(h.begin(), h.end(), raw[i].begin() + 1);
+		encoded[i] = arrToStr(hash160ToAddress(h));
+	}
+
+	add("base58Encode", [&](uint64_t n) {
+		uint64_t acc = 0;
+		for (uint64_t i = 0; i < n; i++) acc += base58Encode(raw[i % batchSize], base58map)[1];
+		return acc;
+	});
+
+	add("base58Decode", [&](uint64_t n) {
+		uint64_t acc = 0;
+		for (uint64_t i = 0; i < n; i++) acc += base58Decode(encoded[i % batchSize])[1];
+		return acc;
+	});
+
+	add("privateKeyToAddress", [&](uint64_t n) {
+		uint64_t acc = 0;
+		auto k = prv;
+		for (uint64_t i = 0; i < n; i++) {
+			k[31] = static_cast<uint8_t>(i);
+			acc += privateKeyToAddress(k, ctx)[1];
+		}
+		return acc;
+	});
+
+	// Lookups in an index of indexSize random P2PKH outputs
+	// Real scans are all misses, hit-heavy shows the cost of the bucket walk when the key is present
+	if (selected("checkHash160_miss_heavy") || selected("checkHash160_hit_heavy")) {
+		addresses.clear();
+		addresses.reserve(cfg.indexSize);
+		std::vector<TypedHash160> present;
+		for (size_t i = 0; i < cfg.indexSize; i++) {
+			TypedHash160 key{ AddressType::P2PKH, bytes.next<20>() };
+			addresses.emplace(key, Funded{ i + 1, Network::Bitcoin });
+			if (present.size() < 4096) present.push_back(key);
+		}
+		std::vector<TypedHash160> missHeavy(4096), hitHeavy(4096);
+		for (size_t i = 0; i < 4096; i++) {
+			missHeavy[i] = { AddressType::P2PKH, bytes.next<20>() };
+			hitHeavy[i] = i % 10 == 0 ? missHeavy[i] : present[i];
+		}
+		auto lookups = [&](std::vector<TypedHash160> const& keys) {
+			return [&](uint64_t n) {
+				uint64_t acc = 0;
+				for (uint64_t i = 0; i < n; i++) {
+					if (auto f = checkHash160(keys[i % keys.size()])) acc += f->balance;
+				}
+				return acc + 1;
+			};
+		};
+		add("checkHash160_miss_heavy", lookups(missHeavy));
+		add("checkHash160_hit_heavy", lookups(hitHeavy));
+		addresses.clear();
+	}
+
+	secp256k1_context_destroy(ctx);
+	return results;
+}
+
+// Keys/s of the whole pipeline on a synthetic index, as WMiner --bench measures it
+double runEndToEnd(Config const& cfg) {
+	Options opts;
+	opts.bench = true;
+	opts.benchSeconds = cfg.e2eSeconds;
+	opts.threads = std::max(cfg.threads, 1u);
+	auto report = runBench(opts);
+	if (report.interrupted) throw std::runtime_error{ "Interrupted" };
+	double keysPerSec = report.totals.keys / report.seconds;
+	std::cout << std::left << std::setw(28) << "end_to_end" << std::right << std::fixed << std::setprecision(0)
+		<< std::setw(12) << keysPerSec << " keys/s, " << opts.threads << " thread(s)" << std::endl;
+	return keysPerSec;
+}
+
+// What the figures depend on besides the code: the CPU, its features, the compiler and the build flags
+struct Host {
+	std::string cpu;
+	std::string cpuFlags;
+	std::string compiler;
+	std::string build;
+};
+
+Host describeHost() {
+	Host h;
+	h.cpu = cpuModel();
+	std::ifstream info{ "/proc/cpuinfo" };
+	std::string line;
+	while (std::getline(info, line)) {
+		auto colon = line.find(':');
+		if (colon == std::string::npos) continue;
+		auto key = line.substr(0, line.find_last_not_of(" \t", colon - 1) + 1);
+		auto value = colon + 2 <= line.size() ? line.substr(colon + 2) : "";
+		if (key == "flags" && h.cpuFlags.empty()) {
+			// Only the features the kernels or libsecp256k1 can use
+			std::istringstream is{ value };
+			std::set<std::string> all;
+			for (std::string f; is >> f;) all.insert(f);
+			for (auto f : { "sse4_1", "avx", "avx2", "avx512f", "bmi2", "adx", "sha_ni" }) {
+				if (all.count(f)) h.cpuFlags += (h.cpuFlags.empty() ? "" : " ") + std::string{ f };
+			}
+		}
+	}
+#if defined(__clang__)
+	h.compiler = "clang " __clang_version__;
+#elif defined(__GNUC__)
+	h.compiler = "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+	h.compiler = "msvc " + std::to_string(_MSC_VER);
+#endif
+	std::vector<const char*> build;
+#ifdef __OPTIMIZE__
+	build.push_back("optimized");
+#endif
+#ifdef NDEBUG
+	build.push_back("NDEBUG");
+#endif
+#ifdef __AVX2__
+	build.push_back("avx2");
+#endif
+#ifdef __AVX512F__
+	build.push_back("avx512f");
+#endif
+#ifdef __SHA__
+	build.push_back("sha");
+#endif
+	for (auto b : build) h.build += (h.build.empty() ? "" : " ") + std::string{ b };
+	return h;
+}
+
+std::string jsonString(std::string const& s) {
+	std::string r = "\"";
+	for (char c : s) {
+		if (c == '"' || c == '\\') r += '\\';
+		r += c;
+	}
+	return r + "\"";
+}
+
+// One benchmark per line, readBaseline relies on it
+void writeJson(std::ostream& os, Host const& host, std::vector<Summary> const& results) {
+	os << "{\n  \"host\": {\n";
+	os << "    \"cpu\": " << jsonString(host.cpu) << ",\n";
+	os << "    \"cpu_flags\": " << jsonString(host.cpuFlags) << ",\n";
+	os << "    \"compiler\": " << jsonString(host.compiler) << ",\n";
+	os << "    \"build\": " << jsonString(host.build) << "\n";
+	os << "  },\n  \"benchmarks\": [\n";
+	for (size_t i = 0; i < results.size(); i++) {
+		auto const& r = results[i];
+		os << std::setprecision(6) << "    { \"name\": \"" << r.name << "\", \"unit\": \"" << r.unit << "\", \"median\": " << r.median
+			<< ", \"ci_low\": " << r.low << ", \"ci_high\": " << r.high << ", \"ci_level\": " << r.level << ", \"cycles_per_op\": ";
+		if (std::isnan(r.cyclesPerOp)) os << "null";
+		else os << r.cyclesPerOp;
+		os << ", \"samples\": [";
+		for (size_t j = 0; j < r.samples.size(); j++) os << (j ? ", " : "") << r.samples[j];
+		os << "] }" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	os << "  ]\n}\n";
+}
+
+// Value of "key": in a line of writeJson, numbers and plain strings only
+std::optional<std::string> jsonField(std::string const& line, std::string const& key) {
+	auto pos = line.find("\"" + key + "\": ");
+	if (pos == std::string::npos) return std::nullopt;
+	pos += key.size() + 4;
+	if (pos < line.size() && line[pos] == '"') {
+		std::string r;
+		for (size_t i = pos + 1; i < line.size() && line[i] != '"'; i++) {
+			if (line[i] == '\\' && i + 1 < line.size()) i++;
+			r += line[i];
+		}
+		return r;
+	}
+	return line.substr(pos, line.find_first_of(",}", pos) - pos);
+}
+
+struct Baseline {
+	Host host;
+	std::map<std::string, Summary> results;
+};
+
+Baseline readBaseline(std::string const& path) {
+	std::ifstream f{ path };
+	if (!f) throw std::runtime_error{ "Cannot open " + path };
+	Baseline b;
+	std::string line;
+	while (std::getline(f, line)) {
+		if (auto v = jsonField(line, "cpu")) b.host.cpu = *v;
+		else if (auto v = jsonField(line, "cpu_flags")) b.host.cpuFlags = *v;
+		else if (auto v = jsonField(line, "compiler")) b.host.compiler = *v;
+		else if (auto v = jsonField(line, "build")) b.host.build = *v;
+		else if (auto name = jsonField(line, "name")) {
+			Summary r;
+			r.name = *name;
+			r.unit = jsonField(line, "unit").value_or("ns_per_op");
+			r.higherIsBetter = r.unit == "keys_per_s";
+			r.median = std::stod(jsonField(line, "median").value_or("nan"));
+			r.low = std::stod(jsonField(line, "ci_low").value_or("nan"));
+			r.high = std::stod(jsonField(line, "ci_high").value_or("nan"));
+			b.results[r.name] = r;
+		}
+	}
+	if (b.results.empty()) throw std::runtime_error{ "No benchmark in " + path };
+	return b;
+}
+
+// Prints the change of every metric found in both, returns the number of regressions
+// A regression is a median worse than the baseline by more than the threshold whose interval does not overlap the baseline one,
+// so the noise of a busy machine is not reported
+size_t compare(Baseline const& base, Host const& host, std::vector<Summary> const& results, double threshold) {
+	auto differs = [](const char* what, std::string const& a, std::string const& b) {
+		if (a != b) std::cout << "Warning: " << what << " differs from the baseline: " << b << " (baseline " << a << ")" << std::endl;
+	};
+	differs("CPU", base.host.cpu, host.cpu);
+	differs("CPU flags", base.host.cpuFlags, host.cpuFlags);
+	differs("compiler", base.host.compiler, host.compiler);
+	differs("build", base.host.build, host.build);
+
+	size_t regressions = 0;
+	std::cout << std::endl << std::left << std::setw(28) << "benchmark" << std::right << std::setw(14) << "baseline" << std::setw(14) << "now" << std::setw(10) << "change" << std::endl;
+	for (auto const& r : results) {
+		auto it = base.results.find(r.name);
+		if (it == base.results.end()) {
+			std::cout << std::left << std::setw(28) << r.name << std::right << std::setw(14) << "-" << std::setw(14) << std::setprecision(1) << r.median << "  new" << std::endl;
+			continue;
+		}
+		auto const& b = it->second;
+		// Positive when slower
+		double worse = r.higherIsBetter ? (b.median - r.median) / b.median : (r.median - b.median) / b.median;
+		bool separated = r.higherIsBetter ? r.high < b.low : r.low > b.high;
+		bool regressed = 100 * worse > threshold && separated;
+		regressions += regressed;
+		std::cout << std::left << std::setw(28) << r.name << std::right << std::fixed << std::setprecision(1)
+			<< std::setw(14) << b.median << std::setw(14) << r.median << std::showpos << std::setw(9) << 100 * worse << "%" << std::noshowpos
+			<< (regressed ? "  REGRESSION" : separated && worse < 0 ? "  faster" : "") << std::endl;
+	}
+	return regressions;
+}
+
+void printUsage() {
+	std::cout << "Usage wm-bench [options]" << std::endl;
+	std::cout << "  --min-time <s>      Minimum duration of one measurement, default 0.5" << std::endl;
+	std::cout << "  --filter <text>     Only run the benchmarks whose name contains text" << std::endl;
+	std::cout << "  --index-size <n>    Addresses in the synthetic index of the lookup benchmarks, default 1000000" << std::endl;
+	std::cout << "  --json <file>       Also write the results as JSON, - for stdout, a baseline for --compare" << std::endl;
+	std::cout << "  --repeat <n>        Runs of the suite, medians and confidence intervals are taken over them" << std::endl;
+	std::cout << "  --e2e-time <s>      Duration of the end to end pipeline run, default 3, 0 to skip it" << std::endl;
+	std::cout << "  --threads <n>       Workers of the end to end run, default all cores" << std::endl;
+	std::cout << "  --compare <file>    Compare with a baseline written by --json, exit code 3 on a regression, 5 runs by default" << std::endl;
+	std::cout << "  --threshold <pct>   Slowdown flagged as a regression, default 5" << std::endl;
+}
+
+Config parseOptions(int argc, char** argv) {
+	Config cfg;
+	bool hasRepeat = false;
+	for (int i = 1; i < argc; i++) {
+		std::string arg{ argv[i] };
+		auto value = [&]() -> std::string {
+			if (i + 1 >= argc) throw std::runtime_error{ "Missing value for " + arg };
+			return argv[++i];
+		};
+		if (arg == "--min-time") cfg.minSeconds = std::stod(value());
+		else if (arg == "--filter") cfg.filter = value();
+		else if (arg == "--index-size") cfg.indexSize = std::stoull(value());
+		else if (arg == "--json") cfg.jsonFile = value();
+		else if (arg == "--repeat") {
+			cfg.repeat = static_cast<unsigned>(std::stoul(value()));
+			hasRepeat = true;
+		}
+		else if (arg == "--e2e-time") cfg.e2eSeconds = std::stod(value());
+		else if (arg == "--threads") cfg.threads = static_cast<unsigned>(std::stoul(value()));
+		else if (arg == "--compare") cfg.compareFile = value();
+		else if (arg == "--threshold") cfg.threshold = std::stod(value());
+		else throw std::runtime_error{ "Unknown option " + arg };
+	}
+	if (!cfg.compareFile.empty() && !hasRepeat) cfg.repeat = 5;
+	if (cfg.repeat == 0) throw std::runtime_error{ "--repeat must be at least 1" };
+	return cfg;
+}
+
+}
+
+int main(int argc, char** argv) {
+	bench::Config cfg;
+	try {
+		cfg = bench::parseOptions(argc, argv);
+	}
+	catch (const std::exception& e) {
+		std::cout << e.what() << std::endl;
+		bench::printUsage();
+		return 1;
+	}
+
+	std::signal(SIGINT, onStopSignal);
+	size_t regressions = 0;
+	try {
+		std::optional<bench::Baseline> baseline;
+		if (!cfg.compareFile.empty()) baseline = bench::readBaseline(cfg.compareFile);
+
+		// Summaries in the order of the first run, kernels then end to end
+		std::vector<bench::Summary> summaries;
+		std::vector<std::vector<double>> cycles;
+		auto sample = [&](std::string const& name, std::string const& unit, double value, double cyclesPerOp) {
+			auto it = std::find_if(summaries.begin(), summaries.end(), [&](auto const& s) { return s.name == name; });
+			if (it == summaries.end()) {
+				bench::Summary summary;
+				summary.name = name;
+				summary.unit = unit;
+				summary.higherIsBetter = unit == "keys_per_s";
+				summaries.push_back(summary);
+				cycles.emplace_back();
+				it = summaries.end() - 1;
+			}
+			it->samples.push_back(value);
+			if (!std::isnan(cyclesPerOp)) cycles[it - summaries.begin()].push_back(cyclesPerOp);
+		};
+		for (unsigned run = 0; run < cfg.repeat; run++) {
+			if (cfg.repeat > 1) std::cout << "Run " << run + 1 << "/" << cfg.repeat << std::endl;
+			for (auto const& r : bench::runKernels(cfg)) sample(r.name, "ns_per_op", r.nsPerOp, r.cyclesPerOp);
+		}
+		if (cfg.e2eSeconds > 0 && (cfg.filter.empty() || std::string{ "end_to_end" }.find(cfg.filter) != std::string::npos)) {
+			loadSyntheticIndex(cfg.indexSize);
+			for (unsigned run = 0; run < cfg.repeat; run++) sample("end_to_end", "keys_per_s", bench::runEndToEnd(cfg), std::nan(""));
+		}
+		for (size_t i = 0; i < summaries.size(); i++) {
+			summaries[i].finalize();
+			summaries[i].cyclesPerOp = bench::medianOf(cycles[i]);
+		}
+
+		auto host = bench::describeHost();
+		if (cfg.repeat > 1 && !baseline) {
+			std::cout << std::endl << "Medians over " << cfg.repeat << " runs" << std::endl;
+			for (auto const& s : summaries) {
+				std::cout << std::left << std::setw(28) << s.name << std::right << std::fixed << std::setprecision(1) << std::setw(12) << s.median << " " << s.unit
+					<< "  [" << s.low << ", " << s.high << "] at " << std::setprecision(0) << 100 * s.level << "%" << std::endl;
+			}
+		}
+		if (baseline) {
+			regressions = bench::compare(*baseline, host, summaries, cfg.threshold);
+			std::cout << (regressions ? std::to_string(regressions) + " regression(s) beyond " : "No regression beyond ") << cfg.threshold << "%" << std::endl;
+		}
+		if (cfg.jsonFile == "-") {
+			bench::writeJson(std::cout, host, summaries);
+		}
+		else if (!cfg.jsonFile.empty()) {
+			std::ofstream f{ cfg.jsonFile };
+			bench::writeJson(f, host, summaries);
+			if (!f) throw std::runtime_error{ "Cannot write " + cfg.jsonFile };
+		}
+	}
+	catch (const std::exception& e) {
+		std::cout << e.what() << std::endl;
+		return 2;
+	}
+	return regressions ? 3 : 0;
+}
@@ -0,0 +1,151 @@
+﻿#pragma once
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <stdexcept>
+#include "range.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Range scan progress saved on disk
+// Plain text, one record per line:
+//   walletminer-checkpoint 1
+//   range <start> <end> <contiguous|interleave>
+//   completed <first> <last> <stride>
+//   worker <id> <next> <end> <stride>
+//   pending <next> <end> <stride>
+struct Checkpoint {
+	u256 start{};
+	u256 end{};
+	bool interleave = false;
+	RangeSnapshot state;
+};
+
+// Flushes a FILE* down to the disk
+inline bool syncFile(FILE* f) {
+	if (std::fflush(f) != 0) return false;
+#ifdef _WIN32
+	return _commit(_fileno(f)) == 0;
+#else
+	return fsync(fileno(f)) == 0;
+#endif
+}
+
+// Writes the checkpoint to path.tmp, syncs it then renames it over path
+// A crash at any point leaves either the old or the new checkpoint, never a torn one
+inline void saveCheckpoint(std::string const& path, Checkpoint const& cp) {
+	std::ostringstream os;
+	auto writeSeg = [&os](Segment const& seg) {
+		os << u256ToHex(seg.next) << ' ' << u256ToHex(seg.end) << ' ' << seg.stride << '\n';
+	};
+	os << "walletminer-checkpoint 1\n";
+	os << "range " << u256ToHex(cp.start) << ' ' << u256ToHex(cp.end) << ' ' << (cp.interleave ? "interleave" : "contiguous") << '\n';
+	for (auto const& seg : cp.state.completed) {
+		os << "completed ";
+		writeSeg(seg);
+	}
+	for (auto const& w : cp.state.inflight) {
+		os << "worker " << w.first << ' ';
+		writeSeg(w.second);
+	}
+	for (auto const& seg : cp.state.pending) {
+		os << "pending ";
+		writeSeg(seg);
+	}
+	std::string data = os.str();
+
+	std::string tmp = path + ".tmp";
+	FILE* f = std::fopen(tmp.c_str(), "wb");
+	if (!f) {
+		throw std::runtime_error{ "Cannot write checkpoint " + tmp };
+	}
+	bool ok = std::fwrite(data.data(), 1, data.size(), f) == data.size() && syncFile(f);
+	ok = std::fclose(f) == 0 && ok;
+	if (!ok) {
+		throw std::runtime_error{ "Cannot write checkpoint " + tmp };
+	}
+	std::filesystem::rename(tmp, path);
+
+#ifndef _WIN32
+	// Make the rename itself durable
+	auto dir = std::filesystem::absolute(path).parent_path();
+	int fd = open(dir.c_str(), O_RDONLY);
+	if (fd >= 0) {
+		fsync(fd);
+		close(fd);
+	}
+#endif
+}
+
+// Returns nullopt when there is no checkpoint at path
+inline std::optional<Checkpoint> loadCheckpoint(std::string const& path) {
+	std::ifstream f{ path };
+	if (f.fail()) {
+		return std::nullopt;
+	}
+
+	Checkpoint cp;
+	std::string line;
+	std::getline(f, line);
+	if (line != "walletminer-checkpoint 1") {
+		throw std::runtime_error{ "Unknown checkpoint format in " + path };
+	}
+
+	auto readSeg = [&path](std::istringstream& is) {
+		std::string next, end;
+		Segment seg;
+		if (!(is >> next >> end >> seg.stride) || seg.stride == 0) {
+			throw std::runtime_error{ "Corrupted checkpoint " + path };
+		}
+		seg.next = u256FromHex(next);
+		seg.end = u256FromHex(end);
+		return seg;
+	};
+
+	bool hasRange = false;
+	while (std::getline(f, line)) {
+		if (line.empty()) continue;
+		std::istringstream is{ line };
+		std::string type;
+		is >> type;
+		if (type == "range") {
+			std::string start, end, mode;
+			if (!(is >> start >> end >> mode)) {
+				throw std::runtime_error{ "Corrupted checkpoint " + path };
+			}
+			cp.start = u256FromHex(start);
+			cp.end = u256FromHex(end);
+			cp.interleave = mode == "interleave";
+			hasRange = true;
+		}
+		else if (type == "completed") {
+			cp.state.completed.push_back(readSeg(is));
+		}
+		else if (type == "worker") {
+			unsigned id;
+			if (!(is >> id)) {
+				throw std::runtime_error{ "Corrupted checkpoint " + path };
+			}
+			cp.state.inflight.emplace_back(id, readSeg(is));
+		}
+		else if (type == "pending") {
+			cp.state.pending.push_back(readSeg(is));
+		}
+		else {
+			throw std::runtime_error{ "Corrupted checkpoint " + path };
+		}
+	}
+	if (!hasRange) {
+		throw std::runtime_error{ "Corrupted checkpoint " + path };
+	}
+	return cp;
+}
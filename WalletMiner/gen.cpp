@@ -0,0 +1,202 @@
+﻿// wm-gen: writes a synthetic blockchair style balance dump, to benchmark the loader and the index without a real one
+// Built from the same sources, WalletMiner.cpp is included without its main()
+#define WALLETMINER_NO_MAIN
+#include "WalletMiner.cpp"
+
+namespace gen {
+
+struct Config {
+	std::string out;
+	uint64_t rows = 1'000'000;
+	uint64_t seed = 42;
+	unsigned threads = std::thread::hardware_concurrency();
+	Network network = Network::Bitcoin;
+	std::vector<std::string> plant; // Private keys whose addresses are written among the random rows
+};
+
+// Rows are made by blocks, each from its own seed, the file only depends on the seed and not on the thread count
+static constexpr uint64_t blockRows = 1 << 16;
+
+// Share of the rows by type, in percent, close to the bitcoin dumps
+// P2WSH rows are in the dumps too, the loader skips them
+enum class RowType { P2PKH, P2SH, P2WPKH, P2WSH, P2TR };
+static constexpr std::pair<RowType, unsigned> mix[] = {
+	{ RowType::P2PKH, 50 }, { RowType::P2SH, 25 }, { RowType::P2WPKH, 15 }, { RowType::P2WSH, 5 }, { RowType::P2TR, 5 },
+};
+
+template<size_t N>
+std::array<uint8_t, N> randomBytes(std::mt19937_64& rng) {
+	std::array<uint8_t, N> r;
+	for (size_t i = 0; i < N; i += 8) {
+		uint64_t v = rng();
+		std::memcpy(r.data() + i, &v, std::min<size_t>(8, N - i));
+	}
+	return r;
+}
+
+// Valid, checksummed address of a random script of the given type
+// Chains without segwit get a P2PKH instead of the bech32 types
+std::string randomAddress(RowType type, Network network, std::mt19937_64& rng) {
+	char const* hrp = networkParams(network).hrp;
+	switch (type) {
+	case RowType::P2SH: return encodeAddress({ AddressType::P2SH, randomBytes<20>(rng) }, network);
+	case RowType::P2WPKH: if (hrp) return encodeAddress({ AddressType::P2WPKH, randomBytes<20>(rng) }, network); break;
+	case RowType::P2WSH: if (hrp) { auto h = randomBytes<32>(rng); return segwitAddress(hrp, 0, h.data(), h.size()); } break;
+	case RowType::P2TR: if (hrp) return encodeAddress(randomBytes<32>(rng), network); break;
+	default: break;
+	}
+	return encodeAddress({ AddressType::P2PKH, randomBytes<20>(rng) }, network);
+}
+
+// Log-normal balances around 0.001 coin with a heavy tail, from 1 unit to a few million coins
+uint64_t randomBalance(std::mt19937_64& rng) {
+	std::lognormal_distribution<double> d{ std::log(100'000.0), 3.0 };
+	return static_cast<uint64_t>(std::clamp(d(rng), 1.0, 2e14));
+}
+
+// Planted rows: every address of each key, and the address the startup check of WMiner looks for
+std::vector<std::string> plantedRows(Config const& cfg) {
+	std::vector<std::string> rows;
+	secp256k1_context* ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+	uint64_t balance = 100'000;
+	for (auto const& hex : cfg.plant) {
+		auto prv = u256FromHex(hex);
+		secp256k1_pubkey pub;
+		if (!checkValidPrvKey(prv) || !secp256k1_ec_pubkey_create(ctx, &pub, prv.data())) {
+			secp256k1_context_destroy(ctx);
+			throw std::runtime_error{ "Invalid private key " + hex };
+		}
+		for (auto const& address : derivedAddresses(pub, ctx, cfg.network)) {
+			std::cout << u256ToHex(prv) << " => " << address << ", " << balance << " " << networkParams(cfg.network).unit << std::endl;
+			rows.push_back(address + "\t" + std::to_string(balance++));
+		}
+	}
+	secp256k1_context_destroy(ctx);
+	if (cfg.network == Network::Bitcoin) {
+		rows.push_back("1LruNZjwamWJXThX2Y8C2d47QqhAkkc5os\t" + std::to_string(balance));
+	}
+	return rows;
+}
+
+void generate(Config const& cfg) {
+	auto planted = plantedRows(cfg);
+	if (planted.size() > cfg.rows) throw std::runtime_error{ "--rows is smaller than the " + std::to_string(planted.size()) + " planted rows" };
+
+	// Row numbers of the planted rows, spread over the file
+	std::map<uint64_t, std::string const*> plantedAt;
+	std::mt19937_64 rng{ cfg.seed };
+	for (auto const& row : planted) {
+		uint64_t at;
+		do at = rng() % cfg.rows; while (plantedAt.count(at));
+		plantedAt[at] = &row;
+	}
+
+	std::ofstream f{ cfg.out, std::ios::binary };
+	if (!f) throw std::runtime_error{ "Cannot open " + cfg.out };
+	f << "address\tbalance\n";
+
+	unsigned threads = std::max(cfg.threads, 1u);
+	uint64_t blocks = (cfg.rows + blockRows - 1) / blockRows;
+	std::vector<std::string> text(threads);
+	for (uint64_t first = 0; first < blocks; first += threads) {
+		std::vector<std::thread> pool;
+		for (unsigned t = 0; t < threads && first + t < blocks; t++) {
+			pool.emplace_back([&, t]() {
+				uint64_t block = first + t;
+				std::seed_seq seq{ cfg.seed, block };
+				std::mt19937_64 rng{ seq };
+				std::uniform_int_distribution<unsigned> percent{ 0, 99 };
+				auto& out = text[t];
+				out.clear();
+				for (uint64_t row = block * blockRows; row < std::min(cfg.rows, (block + 1) * blockRows); row++) {
+					// Random draws are made for planted rows too, the other rows stay the same whatever is planted
+					unsigned p = percent(rng);
+					RowType type = mix[0].first;
+					for (auto [m, share] : mix) {
+						if (p < share) { type = m; break; }
+						p -= share;
+					}
+					auto address = randomAddress(type, cfg.network, rng);
+					auto balance = randomBalance(rng);
+					if (auto it = plantedAt.find(row); it != plantedAt.end()) out += *it->second;
+					else out += address + "\t" + std::to_string(balance);
+					out += '\n';
+				}
+			});
+		}
+		for (auto& th : pool) th.join();
+		for (unsigned t = 0; t < threads && first + t < blocks; t++) f << text[t];
+		if (!f) throw std::runtime_error{ "Cannot write " + cfg.out };
+	}
+	std::cout << "Wrote " << cfg.rows << " rows (" << planted.size() << " planted) to " << cfg.out << std::endl;
+}
+
+void printUsage() {
+	std::cout << "Usage wm-gen [options] <out.tsv>" << std::endl;
+	std::cout << "  --rows <n>          Rows to write, 10m or 500k also work, default 1m" << std::endl;
+	std::cout << "  --seed <n>          Seed of the random rows, default 42" << std::endl;
+	std::cout << "  --threads <n>       Threads formatting the rows" << std::endl;
+	std::cout << "  --chain <name>      bitcoin (default), testnet, litecoin, dogecoin, bitcoin-cash" << std::endl;
+	std::cout << "  --plant <hex>       Also write every address of this private key, repeatable" << std::endl;
+	std::cout << "                      Default be63955589062b68320f0a3d5b450551c67bbb5f6e5b34cec57738f3a96316a9" << std::endl;
+}
+
+// 1000, 500k, 10m
+uint64_t parseCount(std::string const& text) {
+	size_t pos = 0;
+	uint64_t value = std::stoull(text, &pos);
+	std::string unit = text.substr(pos);
+	if (unit == "k") return value * 1'000;
+	if (unit == "m") return value * 1'000'000;
+	if (!unit.empty()) throw std::runtime_error{ "Invalid count " + text };
+	return value;
+}
+
+Config parseOptions(int argc, char** argv) {
+	Config cfg;
+	for (int i = 1; i < argc; i++) {
+		std::string arg{ argv[i] };
+		auto value = [&]() -> std::string {
+			if (i + 1 >= argc) throw std::runtime_error{ "Missing value for " + arg };
+			return argv[++i];
+		};
+		if (arg == "--rows") cfg.rows = parseCount(value());
+		else if (arg == "--seed") cfg.seed = std::stoull(value());
+		else if (arg == "--threads") cfg.threads = static_cast<unsigned>(std::stoul(value()));
+		else if (arg == "--chain") {
+			auto name = value();
+			auto network = networkFromName(name);
+			if (!network) throw std::runtime_error{ "Unknown chain " + name };
+			cfg.network = *network;
+		}
+		else if (arg == "--plant") cfg.plant.push_back(value());
+		else if (arg.starts_with("--")) throw std::runtime_error{ "Unknown option " + arg };
+		else cfg.out = arg;
+	}
+	if (cfg.out.empty()) throw std::runtime_error{ "Missing output file" };
+	if (cfg.plant.empty()) cfg.plant.push_back("be63955589062b68320f0a3d5b450551c67bbb5f6e5b34cec57738f3a96316a9");
+	return cfg;
+}
+
+}
+
+int main(int argc, char** argv) {
+	gen::Config cfg;
+	try {
+		cfg = gen::parseOptions(argc, argv);
+	}
+	catch (const std::exception& e) {
+		std::cout << e.what() << std::endl;
+		gen::printUsage();
+		return 1;
+	}
+
+	try {
+		gen::generate(cfg);
+	}
+	catch (const std::exception& e) {
+		std::cout << e.what() << std::endl;
+		return 2;
+	}
+	return 0;
+}
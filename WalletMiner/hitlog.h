@@ -0,0 +1,50 @@
+﻿#pragma once
+
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Results file opened once in append mode, every line is synced before write returns
+// Several processes can share it, O_APPEND keeps their lines whole
+class HitLog {
+public:
+	explicit HitLog(std::string const& path) {
+#ifdef _WIN32
+		fd = _open(path.c_str(), _O_WRONLY | _O_APPEND | _O_CREAT | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+		fd = open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+#endif
+		if (fd < 0) throw std::runtime_error{ "Cannot open " + path };
+	}
+
+	~HitLog() {
+#ifdef _WIN32
+		_close(fd);
+#else
+		close(fd);
+#endif
+	}
+
+	HitLog(HitLog const&) = delete;
+	HitLog& operator=(HitLog const&) = delete;
+
+	// A single write call per line, false on I/O error
+	bool write(std::string const& line) {
+#ifdef _WIN32
+		return _write(fd, line.data(), static_cast<unsigned>(line.size())) == static_cast<int>(line.size()) && _commit(fd) == 0;
+#else
+		return ::write(fd, line.data(), line.size()) == static_cast<ssize_t>(line.size()) && fsync(fd) == 0;
+#endif
+	}
+
+private:
+	int fd;
+};
@@ -0,0 +1,135 @@
+﻿#pragma once
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include "range.h"
+
+// Keyspace ledger owned by the coordinator
+// Pending work is leased to remote workers for a limited time, a lease that
+// is neither renewed nor completed in time goes back to the front of the queue
+class LeaseLedger {
+public:
+	using clock = std::chrono::steady_clock;
+
+	struct Lease {
+		uint64_t id = 0;
+		Segment seg;
+		std::string worker;
+		clock::time_point deadline;
+	};
+
+	LeaseLedger(u256 const& start, u256 const& end) {
+		Segment seg;
+		seg.next = start;
+		seg.end = end;
+		pending.push_back(seg);
+	}
+
+	// Resumes from a checkpoint, leases of the previous run are issued again
+	explicit LeaseLedger(RangeSnapshot const& snapshot) {
+		completed = snapshot.completed;
+		for (auto const& l : snapshot.inflight) {
+			pending.push_back(l.second);
+		}
+		pending.insert(pending.end(), snapshot.pending.begin(), snapshot.pending.end());
+	}
+
+	// Cuts up to keys scalars off the pending work, nullopt when nothing is pending
+	std::optional<Lease> grant(std::string const& worker, uint64_t keys, clock::duration timeout) {
+		std::lock_guard lock{ m };
+		if (pending.empty()) return std::nullopt;
+
+		Lease lease;
+		lease.id = nextId++;
+		lease.worker = worker;
+		lease.deadline = clock::now() + timeout;
+		Segment& front = pending.front();
+		if (segmentRemaining(front) <= keys) {
+			lease.seg = front;
+			pending.pop_front();
+		}
+		else {
+			lease.seg = splitSegment(front, u256FromU64(keys));
+		}
+		leases[lease.id] = lease;
+		return lease;
+	}
+
+	// Renews a lease, false if it already expired
+	bool renew(uint64_t id, clock::duration timeout) {
+		std::lock_guard lock{ m };
+		auto it = leases.find(id);
+		if (it == leases.end()) return false;
+		it->second.deadline = clock::now() + timeout;
+		return true;
+	}
+
+	bool complete(uint64_t id) {
+		std::lock_guard lock{ m };
+		auto it = leases.find(id);
+		if (it == leases.end()) return false;
+		addCompleted(completed, it->second.seg);
+		leases.erase(it);
+		return true;
+	}
+
+	// Gives a lease back before its deadline, its whole segment is issued again
+	void release(uint64_t id) {
+		std::lock_guard lock{ m };
+		auto it = leases.find(id);
+		if (it == leases.end()) return;
+		pending.push_front(it->second.seg);
+		leases.erase(it);
+	}
+
+	// Takes back the expired leases, returns how many
+	size_t expire() {
+		std::lock_guard lock{ m };
+		auto now = clock::now();
+		size_t n = 0;
+		for (auto it = leases.begin(); it != leases.end();) {
+			if (it->second.deadline < now) {
+				pending.push_front(it->second.seg);
+				it = leases.erase(it);
+				n++;
+			}
+			else {
+				++it;
+			}
+		}
+		return n;
+	}
+
+	bool finished() const {
+		std::lock_guard lock{ m };
+		return pending.empty() && leases.empty();
+	}
+
+	size_t activeLeases() const {
+		std::lock_guard lock{ m };
+		return leases.size();
+	}
+
+	// Leases are saved as in flight work, so a restart issues them again
+	RangeSnapshot snapshot() const {
+		std::lock_guard lock{ m };
+		RangeSnapshot s;
+		s.pending.assign(pending.begin(), pending.end());
+		for (auto const& l : leases) {
+			s.inflight.emplace_back(static_cast<unsigned>(l.first), l.second.seg);
+		}
+		s.completed = completed;
+		return s;
+	}
+
+private:
+	mutable std::mutex m;
+	std::deque<Segment> pending;
+	std::map<uint64_t, Lease> leases;
+	std::vector<Segment> completed;
+	uint64_t nextId = 1;
+};
@@ -0,0 +1,105 @@
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "net.h"
+
+// Prometheus text exposition format, version 0.0.4
+class MetricsText {
+public:
+	MetricsText() {
+		os << std::setprecision(10);
+	}
+
+	// HELP and TYPE lines, before the samples of a metric
+	void family(std::string const& name, const char* type, const char* help) {
+		os << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+	}
+
+	// labels without braces, label="value",other="value"
+	template<typename T>
+	void sample(std::string const& name, T value, std::string const& labels = {}) {
+		os << name;
+		if (!labels.empty()) os << "{" << labels << "}";
+		os << " " << value << "\n";
+	}
+
+	std::string str() const { return os.str(); }
+
+private:
+	std::ostringstream os;
+};
+
+// Answers GET /metrics with the text of render, one connection at a time on its own thread
+// Scrapes are a few per minute, the page is built from counters the workers publish anyway
+class MetricsServer {
+public:
+	MetricsServer(std::string const& address, std::function<std::string()> render) : listener{ address }, render{ std::move(render) } {
+		thread = std::thread{ [this]() { serve(); } };
+	}
+	MetricsServer(MetricsServer const&) = delete;
+	MetricsServer& operator=(MetricsServer const&) = delete;
+
+	~MetricsServer() {
+		stopping = true;
+		listener.shutdown();
+		thread.join();
+	}
+
+	// "9400" or ":9400" listen on the loopback interface, "0.0.0.0:9400" on every interface
+	static std::string address(std::string const& arg) {
+		if (arg.find(':') == std::string::npos) return "127.0.0.1:" + arg;
+		return arg.starts_with(":") ? "127.0.0.1" + arg : arg;
+	}
+
+private:
+	void serve() {
+		while (!stopping) {
+			Socket s = listener.accept();
+			if (!s.valid()) {
+				if (stopping) break;
+				std::this_thread::sleep_for(std::chrono::milliseconds(10)); // Out of descriptors
+				continue;
+			}
+			s.setTimeout(5); // A silent client does not hold the next scrape
+			try {
+				handle(s);
+			}
+			catch (const std::exception&) {
+				// Client gone
+			}
+		}
+	}
+
+	void handle(Socket& s) {
+		// "GET /metrics HTTP/1.1", then headers up to an empty line
+		std::string request, line;
+		if (!s.readLine(request)) return;
+		while (s.readLine(line) && line != "\r" && !line.empty()) {}
+		std::istringstream is{ request };
+		std::string method, target;
+		is >> method >> target;
+		target = target.substr(0, target.find('?'));
+		if (method != "GET" && method != "HEAD") respond(s, "405 Method Not Allowed", "", false);
+		else if (target != "/metrics") respond(s, "404 Not Found", "", false);
+		else respond(s, "200 OK", render(), method == "HEAD");
+	}
+
+	static void respond(Socket& s, std::string const& status, std::string const& body, bool head) {
+		s.send("HTTP/1.0 " + status + "\r\n"
+			"Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+			"Content-Length: " + std::to_string(body.size()) + "\r\n"
+			"Connection: close\r\n\r\n" + (head ? "" : body));
+	}
+
+	Listener listener;
+	std::function<std::string()> render;
+	std::atomic<bool> stopping{ false };
+	std::thread thread;
+};
@@ -0,0 +1,61 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <utility>
+
+// Unbounded multi producer single consumer queue (Vyukov's linked list)
+// push never takes a lock nor waits, only one thread at a time may pop
+template<typename T>
+class MpscQueue {
+public:
+	MpscQueue() : head{ new Node }, tail{ head.load() } {}
+
+	~MpscQueue() {
+		while (pop()) {}
+		delete tail;
+	}
+
+	MpscQueue(MpscQueue const&) = delete;
+	MpscQueue& operator=(MpscQueue const&) = delete;
+
+	void push(T value) {
+		Node* n = new Node;
+		n->value.emplace(std::move(value));
+		Node* prev = head.exchange(n, std::memory_order_acq_rel);
+		prev->next.store(n, std::memory_order_release);
+		wake();
+	}
+
+	// Empty when nothing is queued, or while a producer is between its two stores
+	std::optional<T> pop() {
+		Node* next = tail->next.load(std::memory_order_acquire);
+		if (!next) return std::nullopt;
+		std::optional<T> value = std::move(next->value);
+		next->value.reset(); // next becomes the new dummy node
+		delete tail;
+		tail = next;
+		return value;
+	}
+
+	// Consumer side sleep: read version(), drain, then wait(version) until the next push or wake
+	uint64_t version() const { return pushes.load(std::memory_order_acquire); }
+
+	void wait(uint64_t seen) const { pushes.wait(seen, std::memory_order_acquire); }
+
+	void wake() {
+		pushes.fetch_add(1, std::memory_order_release);
+		pushes.notify_one();
+	}
+
+private:
+	struct Node {
+		std::atomic<Node*> next{ nullptr };
+		std::optional<T> value;
+	};
+
+	std::atomic<Node*> head; // Last pushed node, producers side
+	Node* tail; // Dummy node before the oldest value, consumer side
+	std::atomic<uint64_t> pushes{ 0 };
+};
@@ -0,0 +1,245 @@
+﻿#pragma once
+
+#include <string>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+using socket_t = SOCKET;
+static constexpr socket_t invalidSocket = INVALID_SOCKET;
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+using socket_t = int;
+static constexpr socket_t invalidSocket = -1;
+#endif
+
+// Line based blocking socket
+// Addresses are "host:port" for TCP or "unix:/path" for a Unix domain socket
+class Socket {
+public:
+	Socket() = default;
+	explicit Socket(socket_t fd) : fd{ fd } {}
+	Socket(Socket const&) = delete;
+	Socket& operator=(Socket const&) = delete;
+	Socket(Socket&& o) noexcept : fd{ std::exchange(o.fd, invalidSocket) }, buffer{ std::move(o.buffer) } {}
+	Socket& operator=(Socket&& o) noexcept {
+		if (this != &o) {
+			close();
+			fd = std::exchange(o.fd, invalidSocket);
+			buffer = std::move(o.buffer);
+		}
+		return *this;
+	}
+	~Socket() { close(); }
+
+	bool valid() const { return fd != invalidSocket; }
+
+	// Sends line followed by \n, throws if the peer is gone
+	void sendLine(std::string const& line) {
+		send(line + '\n');
+	}
+
+	// Sends all of data, throws if the peer is gone
+	void send(std::string const& data) {
+		size_t sent = 0;
+		while (sent < data.size()) {
+#ifdef _WIN32
+			int r = ::send(fd, data.data() + sent, static_cast<int>(data.size() - sent), 0);
+#else
+			ssize_t r = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+#endif
+			if (r <= 0) throw std::runtime_error{ "Connection lost" };
+			sent += static_cast<size_t>(r);
+		}
+	}
+
+	// Reads the next line without its \n, false once the peer closed the connection
+	bool readLine(std::string& line) {
+		while (true) {
+			auto pos = buffer.find('\n');
+			if (pos != std::string::npos) {
+				line = buffer.substr(0, pos);
+				buffer.erase(0, pos + 1);
+				return true;
+			}
+			char chunk[4096];
+			auto r = ::recv(fd, chunk, sizeof(chunk), 0);
+			if (r <= 0) return false;
+			buffer.append(chunk, static_cast<size_t>(r));
+		}
+	}
+
+	// Receives give up after this delay, readLine then returns false
+	void setTimeout(unsigned seconds) {
+#ifdef _WIN32
+		DWORD ms = seconds * 1000;
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&ms), sizeof(ms));
+#else
+		timeval tv{ static_cast<time_t>(seconds), 0 };
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+#endif
+	}
+
+	// Unblocks a thread waiting in readLine
+	void shutdown() {
+		if (valid()) {
+#ifdef _WIN32
+			::shutdown(fd, SD_BOTH);
+#else
+			::shutdown(fd, SHUT_RDWR);
+#endif
+		}
+	}
+
+	void close() {
+		if (valid()) {
+#ifdef _WIN32
+			::closesocket(fd);
+#else
+			::close(fd);
+#endif
+			fd = invalidSocket;
+		}
+	}
+
+	socket_t handle() const { return fd; }
+
+private:
+	socket_t fd = invalidSocket;
+	std::string buffer;
+};
+
+inline void netInit() {
+#ifdef _WIN32
+	static bool initialized = [] {
+		WSADATA data;
+		return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}();
+	if (!initialized) throw std::runtime_error{ "Cannot initialize Winsock" };
+#endif
+}
+
+// Splits "host:port", an empty host means the loopback interface
+inline std::pair<std::string, std::string> splitHostPort(std::string const& address) {
+	auto pos = address.rfind(':');
+	if (pos == std::string::npos) throw std::runtime_error{ "Address must be host:port or unix:/path, got " + address };
+	std::string host = address.substr(0, pos);
+	return { host.empty() ? "127.0.0.1" : host, address.substr(pos + 1) };
+}
+
+inline bool isUnixAddress(std::string const& address) {
+	return address.starts_with("unix:");
+}
+
+#ifndef _WIN32
+inline sockaddr_un unixSockAddr(std::string const& address) {
+	sockaddr_un sa{};
+	sa.sun_family = AF_UNIX;
+	std::string path = address.substr(5);
+	if (path.size() >= sizeof(sa.sun_path)) throw std::runtime_error{ "Unix socket path too long: " + path };
+	path.copy(sa.sun_path, path.size());
+	return sa;
+}
+#endif
+
+inline Socket connectTo(std::string const& address) {
+	netInit();
+	if (isUnixAddress(address)) {
+#ifdef _WIN32
+		throw std::runtime_error{ "Unix sockets are not supported on this platform" };
+#else
+		Socket s{ ::socket(AF_UNIX, SOCK_STREAM, 0) };
+		sockaddr_un sa = unixSockAddr(address);
+		if (!s.valid() || ::connect(s.handle(), reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) != 0) {
+			throw std::runtime_error{ "Cannot connect to " + address };
+		}
+		return s;
+#endif
+	}
+
+	auto [host, port] = splitHostPort(address);
+	addrinfo hints{};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo* res = nullptr;
+	if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0) {
+		throw std::runtime_error{ "Cannot resolve " + address };
+	}
+	Socket s;
+	for (addrinfo* ai = res; ai; ai = ai->ai_next) {
+		Socket attempt{ ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol) };
+		if (attempt.valid() && ::connect(attempt.handle(), ai->ai_addr, static_cast<int>(ai->ai_addrlen)) == 0) {
+			s = std::move(attempt);
+			break;
+		}
+	}
+	freeaddrinfo(res);
+	if (!s.valid()) throw std::runtime_error{ "Cannot connect to " + address };
+
+	// Requests are small and latency bound
+	int one = 1;
+	setsockopt(s.handle(), IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&one), sizeof(one));
+	return s;
+}
+
+class Listener {
+public:
+	explicit Listener(std::string const& address) {
+		netInit();
+		if (isUnixAddress(address)) {
+#ifdef _WIN32
+			throw std::runtime_error{ "Unix sockets are not supported on this platform" };
+#else
+			sockaddr_un sa = unixSockAddr(address);
+			::unlink(sa.sun_path); // Left over by a previous run
+			sock = Socket{ ::socket(AF_UNIX, SOCK_STREAM, 0) };
+			if (!sock.valid() || ::bind(sock.handle(), reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) != 0) {
+				throw std::runtime_error{ "Cannot listen on " + address };
+			}
+#endif
+		}
+		else {
+			auto [host, port] = splitHostPort(address);
+			addrinfo hints{};
+			hints.ai_family = AF_UNSPEC;
+			hints.ai_socktype = SOCK_STREAM;
+			hints.ai_flags = AI_PASSIVE;
+			addrinfo* res = nullptr;
+			if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0 || !res) {
+				throw std::runtime_error{ "Cannot resolve " + address };
+			}
+			sock = Socket{ ::socket(res->ai_family, res->ai_socktype, res->ai_protocol) };
+			int one = 1;
+			setsockopt(sock.handle(), SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&one), sizeof(one));
+			bool bound = sock.valid() && ::bind(sock.handle(), res->ai_addr, static_cast<int>(res->ai_addrlen)) == 0;
+			freeaddrinfo(res);
+			if (!bound) {
+				throw std::runtime_error{ "Cannot listen on " + address };
+			}
+		}
+		if (::listen(sock.handle(), 64) != 0) {
+			throw std::runtime_error{ "Cannot listen on " + address };
+		}
+	}
+
+	// Blocks until a client connects, returns an invalid socket once the listener is shut down
+	Socket accept() {
+		return Socket{ ::accept(sock.handle(), nullptr, nullptr) };
+	}
+
+	void shutdown() {
+		sock.shutdown();
+	}
+
+private:
+	Socket sock;
+};
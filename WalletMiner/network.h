@@ -0,0 +1,39 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+// Chains deriving addresses exactly like Bitcoin, they only differ by the version byte and the bech32 hrp
+// A key and its hash160 are computed once and looked up for every chain at the same time
+enum class Network : uint8_t { Bitcoin, Testnet, Litecoin, Dogecoin, BitcoinCash };
+
+struct NetworkParams {
+	Network id;
+	const char* name; // Prefix of a balance file on the command line, litecoin:ltc.tsv
+	uint8_t p2pkh; // Base58 version bytes
+	uint8_t p2sh;
+	uint8_t p2shLegacy; // Version byte also accepted for P2SH in dumps, Litecoin kept 3... addresses
+	const char* hrp; // Segwit addresses, nullptr on chains without segwit
+	const char* unit; // Balance unit of the dumps
+};
+
+// Bitcoin Cash is read from legacy (base58) dumps, cashaddr rows are skipped
+inline constexpr NetworkParams networks[] = {
+	{ Network::Bitcoin, "bitcoin", 0x00, 0x05, 0x05, "bc", "sat" },
+	{ Network::Testnet, "testnet", 0x6f, 0xc4, 0xc4, "tb", "sat" },
+	{ Network::Litecoin, "litecoin", 0x30, 0x32, 0x05, "ltc", "litoshi" },
+	{ Network::Dogecoin, "dogecoin", 0x1e, 0x16, 0x16, nullptr, "koinu" },
+	{ Network::BitcoinCash, "bitcoin-cash", 0x00, 0x05, 0x05, nullptr, "sat" },
+};
+
+inline NetworkParams const& networkParams(Network n) {
+	return networks[static_cast<size_t>(n)];
+}
+
+inline std::optional<Network> networkFromName(std::string_view name) {
+	for (auto const& n : networks) {
+		if (name == n.name) return n.id;
+	}
+	return std::nullopt;
+}
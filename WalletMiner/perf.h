@@ -0,0 +1,99 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <string>
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+enum HwCounter : unsigned { HwCycles, HwInstructions, HwLlcMisses, HwDtlbMisses, HwBranchMisses, hwCount };
+inline constexpr const char* hwNames[hwCount] = { "cycles", "instructions", "llc_misses", "dtlb_misses", "branch_misses" };
+
+// Hardware counters of the calling thread through perf_event_open, user space only, Linux only
+// They are opened as one group so they count over the same instructions
+// Counters refused by the kernel or missing on the CPU are left out, without cycles the group is not opened at all
+class PerfGroup {
+public:
+	PerfGroup() {
+		for (auto& fd : fds) fd = -1;
+	}
+	PerfGroup(PerfGroup const&) = delete;
+	PerfGroup& operator=(PerfGroup const&) = delete;
+
+	~PerfGroup() {
+#ifdef __linux__
+		for (int fd : fds) {
+			if (fd >= 0) close(fd);
+		}
+#endif
+	}
+
+	// Empty on success, else why the counters are not available
+	std::string open() {
+#ifdef __linux__
+		auto cache = [](uint64_t id, uint64_t op, uint64_t result) { return id | (op << 8) | (result << 16); };
+		std::pair<uint32_t, uint64_t> events[hwCount] = {
+			{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+			{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+			{ PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+			{ PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+			{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+		};
+		for (unsigned c = 0; c < hwCount; c++) {
+			perf_event_attr attr;
+			std::memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = events[c].first;
+			attr.config = events[c].second;
+			attr.disabled = c == 0; // The leader starts the whole group
+			attr.exclude_kernel = 1; // Allowed up to perf_event_paranoid 2
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+			int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, c == 0 ? -1 : fds[0], 0));
+			if (fd < 0) {
+				if (c == 0) return std::string{ "perf_event_open: " } + std::strerror(errno) + (errno == EACCES || errno == EPERM ? ", see /proc/sys/kernel/perf_event_paranoid" : "");
+				continue;
+			}
+			fds[c] = fd;
+			ioctl(fd, PERF_EVENT_IOC_ID, &ids[c]);
+		}
+		ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+		ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		return {};
+#else
+		return "hardware counters need Linux perf_event_open";
+#endif
+	}
+
+	bool has(HwCounter c) const { return fds[c] >= 0; }
+
+	// Counts since open, scaled up when the kernel multiplexed the group, false if the group could not be read
+	bool read(uint64_t (&values)[hwCount]) {
+#ifdef __linux__
+		if (fds[0] < 0) return false;
+		// nr, time enabled, time running, then value and id of each member
+		uint64_t buf[3 + 2 * hwCount];
+		if (::read(fds[0], buf, sizeof(buf)) < static_cast<ssize_t>(3 * sizeof(uint64_t))) return false;
+		double scale = buf[2] ? double(buf[1]) / buf[2] : 0;
+		for (uint64_t i = 0; i < buf[0] && i < hwCount; i++) {
+			for (unsigned c = 0; c < hwCount; c++) {
+				if (fds[c] >= 0 && ids[c] == buf[4 + 2 * i]) values[c] = static_cast<uint64_t>(buf[3 + 2 * i] * scale);
+			}
+		}
+		return true;
+#else
+		(void)values;
+		return false;
+#endif
+	}
+
+private:
+	int fds[hwCount];
+	uint64_t ids[hwCount] = {};
+};
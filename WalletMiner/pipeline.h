@@ -0,0 +1,68 @@
+﻿#pragma once
+
+#include <array>
+#include <cstddef>
+#include <tuple>
+#include <utility>
+
+// Compile-time list of interchangeable policy implementations
+template<typename... Ts>
+struct PolicyList {
+	static constexpr size_t size = sizeof...(Ts);
+};
+
+// Returns the index of the first policy in the list accepting the options
+// Every policy exposes a static bool enabled(Options const&)
+// The last policy of a list is used as the fallback
+template<typename List>
+struct PolicySelector;
+
+template<typename... Ts>
+struct PolicySelector<PolicyList<Ts...>> {
+	template<typename Options>
+	static size_t select(Options const& opts) {
+		size_t index = 0;
+		bool found = false;
+		((found || (found = Ts::enabled(opts)) || (++index, false)), ...);
+		return found ? index : sizeof...(Ts) - 1;
+	}
+};
+
+// Table holding one fully specialised worker per policy combination
+// Worker<K, D, M, R>::run is instantiated for every K, D, M, R of the lists
+// so the hot loop never branches on the configuration
+template<template<typename, typename, typename, typename> class Worker, typename Context,
+	typename KeySources, typename Derivers, typename Matchers, typename Reporters>
+struct PipelineTable;
+
+template<template<typename, typename, typename, typename> class Worker, typename Context,
+	typename... Ks, typename... Ds, typename... Ms, typename... Rs>
+struct PipelineTable<Worker, Context, PolicyList<Ks...>, PolicyList<Ds...>, PolicyList<Ms...>, PolicyList<Rs...>> {
+	using Fn = void(*)(Context&);
+
+	static constexpr size_t nK = sizeof...(Ks);
+	static constexpr size_t nD = sizeof...(Ds);
+	static constexpr size_t nM = sizeof...(Ms);
+	static constexpr size_t nR = sizeof...(Rs);
+	static constexpr size_t size = nK * nD * nM * nR;
+
+	static Fn get(size_t k, size_t d, size_t m, size_t r) {
+		static constexpr std::array<Fn, size> table = build(std::make_index_sequence<size>{});
+		return table[((k * nD + d) * nM + m) * nR + r];
+	}
+
+private:
+	template<size_t I>
+	static constexpr Fn entry() {
+		using K = std::tuple_element_t<I / (nD * nM * nR), std::tuple<Ks...>>;
+		using D = std::tuple_element_t<(I / (nM * nR)) % nD, std::tuple<Ds...>>;
+		using M = std::tuple_element_t<(I / nR) % nM, std::tuple<Ms...>>;
+		using R = std::tuple_element_t<I % nR, std::tuple<Rs...>>;
+		return &Worker<K, D, M, R>::run;
+	}
+
+	template<size_t... I>
+	static constexpr std::array<Fn, size> build(std::index_sequence<I...>) {
+		return { entry<I>()... };
+	}
+};
@@ -0,0 +1,370 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+#include <stdexcept>
+#include "u256.h"
+
+// Walk over the scalars next, next + stride, ... end (end included)
+struct Segment {
+	u256 next{};
+	u256 end{};
+	uint32_t stride = 1;
+};
+
+// Number of scalars left in the segment, saturated at UINT64_MAX
+inline uint64_t segmentRemaining(Segment const& seg) {
+	if (u256Cmp(seg.next, seg.end) > 0) return 0;
+	bool overflow;
+	uint64_t steps = u256ToU64(u256DivU32(u256Sub(seg.end, seg.next), seg.stride), &overflow);
+	if (overflow || steps == UINT64_MAX) return UINT64_MAX;
+	return steps + 1;
+}
+
+// Exact number of scalars left in the segment
+inline u256 segmentCount(Segment const& seg) {
+	if (u256Cmp(seg.next, seg.end) > 0) return u256{};
+	return u256AddU64(u256DivU32(u256Sub(seg.end, seg.next), seg.stride), 1);
+}
+
+// Cuts the first count scalars off seg and returns them as their own segment
+// count must be lower than the number of scalars left
+inline Segment splitSegment(Segment& seg, u256 const& count) {
+	Segment head = seg;
+	u256 offset = u256MulU32(count, seg.stride);
+	seg.next = u256Add(seg.next, offset);
+	head.end = u256Sub(seg.next, u256FromU64(seg.stride));
+	return head;
+}
+
+// Adds a fully walked segment to the list, merging it with its neighbours
+inline void addCompleted(std::vector<Segment>& completed, Segment seg) {
+	for (size_t i = 0; i < completed.size(); i++) {
+		Segment const& c = completed[i];
+		if (c.stride != seg.stride) continue;
+		if (u256Cmp(u256AddU64(c.end, c.stride), seg.next) == 0) {
+			seg.next = c.next;
+		}
+		else if (u256Cmp(u256AddU64(seg.end, seg.stride), c.next) == 0) {
+			seg.end = c.end;
+		}
+		else {
+			continue;
+		}
+		completed.erase(completed.begin() + i);
+		addCompleted(completed, seg);
+		return;
+	}
+	completed.push_back(seg);
+}
+
+// State of a range job at some point in time
+// pending and inflight together hold every scalar not tested yet
+struct RangeSnapshot {
+	std::vector<Segment> pending;
+	std::vector<std::pair<unsigned, Segment>> inflight; // Worker id and its position
+	std::vector<Segment> completed; // Segments walked entirely, next is their first scalar
+};
+
+// Keyspace interval [start, end] shared between the workers
+// Every scalar of the interval is given to exactly one worker
+// Workers take chunks off the front of their own deque and steal half of
+// the last segment of the busiest deque once theirs is empty
+// Chunks are sized to last about targetChunkSeconds at the worker's own speed,
+// so the end of a job only waits for one chunk per worker
+class RangeJob {
+public:
+	static constexpr uint64_t minChunk = 256;
+	static constexpr uint64_t maxChunk = 1ull << 32;
+	static constexpr double targetChunkSeconds = 1.0;
+
+	// interleave = false: each worker gets a contiguous sub range
+	// interleave = true: worker i gets start + i, start + i + workers, ...
+	RangeJob(u256 const& start, u256 const& end, unsigned workers, bool interleave) {
+		init(workers);
+		if (u256Cmp(start, end) > 0) throw std::runtime_error{ "Range start is above range end" };
+
+		u256 total = u256AddU64(u256Sub(end, start), 1);
+		if (interleave) {
+			for (unsigned i = 0; i < workers; i++) {
+				if (u256Cmp(u256FromU64(i), total) >= 0) break;
+				Segment seg;
+				seg.next = u256AddU64(start, i);
+				seg.stride = workers;
+				uint32_t rem;
+				u256DivU32(u256Sub(end, seg.next), workers, &rem);
+				seg.end = u256Sub(end, u256FromU64(rem)); // Last scalar of this stride
+				queues[i]->pending.push_back(seg);
+			}
+		}
+		else {
+			uint32_t rem;
+			u256 per = u256DivU32(total, workers, &rem);
+			u256 cursor = start;
+			for (unsigned i = 0; i < workers; i++) {
+				u256 len = i < rem ? u256AddU64(per, 1) : per;
+				if (u256IsZero(len)) break;
+				Segment seg;
+				seg.next = cursor;
+				seg.end = u256Sub(u256Add(cursor, len), u256FromU64(1));
+				queues[i]->pending.push_back(seg);
+				cursor = u256Add(cursor, len);
+			}
+		}
+	}
+
+	// Resumes a job from a snapshot, remaining segments are dealt round robin
+	RangeJob(RangeSnapshot const& snapshot, unsigned workers) {
+		init(workers);
+		completed = snapshot.completed;
+		unsigned i = 0;
+		for (auto const& w : snapshot.inflight) {
+			queues[i++ % workers]->pending.push_back(w.second);
+		}
+		for (auto const& seg : snapshot.pending) {
+			queues[i++ % workers]->pending.push_back(seg);
+		}
+	}
+
+	// Empty job fed over time with submit(), until close()
+	explicit RangeJob(unsigned workers) {
+		init(workers);
+		open = true;
+	}
+
+	// Adds work to an open job
+	void submit(Segment const& seg) {
+		{
+			auto& q = *queues[nextSubmit++ % queues.size()];
+			std::lock_guard lock{ q.m };
+			q.pending.push_back(seg);
+		}
+		std::lock_guard lock{ feedMutex };
+		feedVersion++;
+		feedCv.notify_all();
+	}
+
+	// Workers waiting for work return from acquire
+	void close() {
+		std::lock_guard lock{ feedMutex };
+		open = false;
+		feedCv.notify_all();
+	}
+
+	// True when every segment handed out has been tested
+	bool idle() const {
+		std::unique_lock noSteal{ stealMutex };
+		for (auto const& q : queues) {
+			std::lock_guard lock{ q->m };
+			if (!q->pending.empty() || !q->inflight.empty()) return false;
+		}
+		return true;
+	}
+
+	// Scalars not handed out yet, saturated at UINT64_MAX
+	uint64_t pendingKeys() const {
+		std::unique_lock noSteal{ stealMutex };
+		uint64_t total = 0;
+		for (auto const& q : queues) {
+			std::lock_guard lock{ q->m };
+			for (auto const& seg : q->pending) {
+				uint64_t left = segmentRemaining(seg);
+				total = left > UINT64_MAX - total ? UINT64_MAX : total + left;
+			}
+		}
+		return total;
+	}
+
+	// True once every scalar of a submitted segment has been tested, whatever the rest of the job does
+	// Its chunks are merged back into one completed segment as they are committed
+	bool tested(Segment const& seg) const {
+		std::lock_guard lock{ completedMutex };
+		for (auto const& c : completed) {
+			if (c.stride != seg.stride || u256Cmp(c.next, seg.next) > 0 || u256Cmp(c.end, seg.end) < 0) continue;
+			uint32_t rem = 0;
+			u256DivU32(u256Sub(seg.next, c.next), c.stride, &rem);
+			if (rem == 0) return true;
+		}
+		return false;
+	}
+
+	// Next chunk to walk for this worker, false once there is nothing left to take or steal
+	// On an open job, waits for more work instead when wait is set
+	// The chunk stays in flight until the worker reports it done
+	bool acquire(unsigned worker, Segment& seg, bool wait = true) {
+		while (true) {
+			uint64_t version;
+			{
+				std::lock_guard lock{ feedMutex };
+				version = feedVersion;
+			}
+			{
+				auto& q = *queues[worker];
+				std::lock_guard lock{ q.m };
+				if (!q.pending.empty()) {
+					seg = takeChunk(q);
+					q.inflight.push_back({ seg.next, seg });
+					return true;
+				}
+			}
+			if (steal(worker)) continue;
+
+			std::unique_lock lock{ feedMutex };
+			if (!open || !wait) return false;
+			feedCv.wait(lock, [&] { return feedVersion != version || !open; });
+		}
+	}
+
+	// Called by the worker once everything it acquired before has been tested
+	// position is the first untested scalar of its current segment, or null if there is none
+	void commit(unsigned worker, Segment const* position) {
+		auto& q = *queues[worker];
+		std::lock_guard lock{ q.m };
+		std::vector<InFlight> kept;
+		for (auto const& f : q.inflight) {
+			if (position && u256Cmp(f.position.end, position->end) == 0 && f.position.stride == position->stride) {
+				kept.push_back({ f.first, *position });
+				continue;
+			}
+			std::lock_guard lockCompleted{ completedMutex };
+			addCompleted(completed, { f.first, f.position.end, f.position.stride });
+		}
+		q.inflight = std::move(kept);
+	}
+
+	RangeSnapshot snapshot() const {
+		std::unique_lock noSteal{ stealMutex }; // Nothing moves between deques while they are read
+		RangeSnapshot s;
+		std::vector<Segment> partial;
+		for (unsigned i = 0; i < queues.size(); i++) {
+			auto& q = *queues[i];
+			std::lock_guard lock{ q.m };
+			s.pending.insert(s.pending.end(), q.pending.begin(), q.pending.end());
+			for (auto const& f : q.inflight) {
+				s.inflight.emplace_back(i, f.position);
+				// Part of the segment already tested
+				if (u256Cmp(f.first, f.position.next) < 0) {
+					partial.push_back({ f.first, u256Sub(f.position.next, u256FromU64(f.position.stride)), f.position.stride });
+				}
+			}
+		}
+		std::lock_guard lock{ completedMutex };
+		s.completed = completed;
+		for (auto const& seg : partial) {
+			addCompleted(s.completed, seg);
+		}
+		return s;
+	}
+
+private:
+	void init(unsigned workers) {
+		if (workers == 0) throw std::runtime_error{ "A range job needs at least one worker" };
+		for (unsigned i = 0; i < workers; i++) {
+			queues.push_back(std::make_unique<Queue>());
+		}
+	}
+
+	// Segment acquired by a worker and not fully tested yet
+	struct InFlight {
+		u256 first; // Where the worker started
+		Segment position;
+	};
+
+	struct Queue {
+		mutable std::mutex m;
+		std::deque<Segment> pending;
+		std::vector<InFlight> inflight;
+
+		// Chunk sizing from the time the previous chunk took
+		uint64_t chunk = minChunk * 16;
+		uint64_t lastChunk = 0;
+		std::chrono::steady_clock::time_point lastChunkStart;
+	};
+
+	// Cuts the next chunk off the front segment of q, q.m must be held
+	Segment takeChunk(Queue& q) {
+		auto now = std::chrono::steady_clock::now();
+		if (q.lastChunk) {
+			double elapsed = std::chrono::duration<double>(now - q.lastChunkStart).count();
+			if (elapsed > 0) {
+				double wanted = q.lastChunk / elapsed * targetChunkSeconds;
+				wanted = std::clamp(wanted, double(minChunk), double(maxChunk));
+				q.chunk = static_cast<uint64_t>((q.chunk + wanted) / 2); // Smooth out noisy samples
+			}
+		}
+
+		Segment& front = q.pending.front();
+		Segment chunk;
+		uint64_t left = segmentRemaining(front);
+		if (left <= q.chunk) {
+			chunk = front;
+			q.pending.pop_front();
+		}
+		else {
+			chunk = splitSegment(front, u256FromU64(q.chunk));
+			left = q.chunk;
+		}
+		q.lastChunk = left;
+		q.lastChunkStart = now;
+		return chunk;
+	}
+
+	// Moves half of the largest pending segment of another worker to the thief
+	// Returns false when no other worker has pending work
+	bool steal(unsigned thief) {
+		std::shared_lock guard{ stealMutex };
+
+		unsigned victim = thief;
+		uint64_t best = 0;
+		for (unsigned i = 0; i < queues.size(); i++) {
+			if (i == thief) continue;
+			auto& q = *queues[i];
+			std::lock_guard lock{ q.m };
+			if (q.pending.empty()) continue;
+			uint64_t left = segmentRemaining(q.pending.back());
+			if (left > best) {
+				best = left;
+				victim = i;
+			}
+		}
+		if (victim == thief) return false;
+
+		auto& vq = *queues[victim];
+		auto& tq = *queues[thief];
+		std::scoped_lock lock{ vq.m, tq.m };
+		if (vq.pending.empty()) return true; // Taken meanwhile, look again
+
+		Segment& tail = vq.pending.back();
+		u256 count = segmentCount(tail);
+		if (u256Cmp(count, u256FromU64(minChunk * 2)) < 0) {
+			tq.pending.push_back(tail);
+			vq.pending.pop_back();
+		}
+		else {
+			// The victim keeps the front half it is about to walk
+			Segment head = splitSegment(tail, u256Sub(count, u256DivU32(count, 2)));
+			tq.pending.push_back(tail);
+			tail = head;
+		}
+		return true;
+	}
+
+	std::vector<std::unique_ptr<Queue>> queues;
+	mutable std::shared_mutex stealMutex;
+
+	// Open jobs only
+	std::mutex feedMutex;
+	std::condition_variable feedCv;
+	uint64_t feedVersion = 0;
+	bool open = false;
+	std::atomic<size_t> nextSubmit = 0;
+	mutable std::mutex completedMutex;
+	std::vector<Segment> completed;
+};
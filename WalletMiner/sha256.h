@@ -0,0 +1,189 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// SHA-256 of the fixed length messages of the hot loop: 33 bytes compressed and 65 bytes uncompressed pubkeys,
+// and BIP340 tagged hashes of 32 bytes keys.
+// Padding and length words are constants, a 33 bytes key is one block and a 65 bytes key two blocks
+// whose second one only carries the last byte: its schedule words up to 31 are mostly constants or drop
+// their zero terms, only the words from 32 are expanded in full.
+// A tagged hash starts with the 64 bytes sha256(tag) | sha256(tag), its state after that block is computed once.
+//
+// sha256Lanes hashes Lanes messages together, every round runs as a loop over the lanes
+// so the compiler turns it into SIMD on whatever vector width the target has.
+
+namespace sha256k {
+
+constexpr uint32_t K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+constexpr uint32_t IV[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+constexpr uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+constexpr uint32_t sigma0(uint32_t x) { return rotr(x, 7) ^ rotr(x, 18) ^ (x >> 3); }
+constexpr uint32_t sigma1(uint32_t x) { return rotr(x, 17) ^ rotr(x, 19) ^ (x >> 10); }
+
+inline uint32_t load32(const uint8_t* p) {
+	return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+inline void store32(uint8_t* p, uint32_t v) {
+	p[0] = uint8_t(v >> 24); p[1] = uint8_t(v >> 16); p[2] = uint8_t(v >> 8); p[3] = uint8_t(v);
+}
+
+// Schedule words from..63, the ones before are filled, lane index last
+template<size_t Lanes>
+inline void expand(uint32_t (&w)[64][Lanes], int from = 16) {
+	for (int t = from; t < 64; t++) {
+		for (size_t l = 0; l < Lanes; l++) {
+			w[t][l] = w[t - 16][l] + sigma0(w[t - 15][l]) + w[t - 7][l] + sigma1(w[t - 2][l]);
+		}
+	}
+}
+
+// Schedule of the last block of a 65 bytes key: w[0] is the last byte and 0x80, w[1..14] are zero and
+// w[15] the bit length, the words up to 31 that do not depend on w[0] are compile time constants
+template<size_t Lanes>
+inline void expandLast65(uint32_t (&w)[64][Lanes]) {
+	constexpr uint32_t len = 65 * 8;
+	constexpr uint32_t w17 = sigma1(len);
+	constexpr uint32_t w19 = sigma1(w17);
+	constexpr uint32_t w21 = sigma1(w19);
+	constexpr uint32_t s23 = sigma1(w21);
+	constexpr uint32_t s30 = sigma0(len);
+	for (size_t l = 0; l < Lanes; l++) {
+		w[16][l] = w[0][l];
+		w[17][l] = w17;
+		w[18][l] = sigma1(w[16][l]);
+		w[19][l] = w19;
+		w[20][l] = sigma1(w[18][l]);
+		w[21][l] = w21;
+		w[22][l] = len + sigma1(w[20][l]);
+		w[23][l] = w[16][l] + s23;
+		w[24][l] = w17 + sigma1(w[22][l]);
+		w[25][l] = w[18][l] + sigma1(w[23][l]);
+		w[26][l] = w19 + sigma1(w[24][l]);
+		w[27][l] = w[20][l] + sigma1(w[25][l]);
+		w[28][l] = w21 + sigma1(w[26][l]);
+		w[29][l] = w[22][l] + sigma1(w[27][l]);
+		w[30][l] = s30 + w[23][l] + sigma1(w[28][l]);
+		w[31][l] = len + sigma0(w[16][l]) + w[24][l] + sigma1(w[29][l]);
+	}
+	expand(w, 32);
+}
+
+// The 64 rounds of one block in every lane over an expanded schedule
+template<size_t Lanes>
+inline void rounds(uint32_t (&state)[8][Lanes], uint32_t const (&w)[64][Lanes]) {
+
+	uint32_t a[Lanes], b[Lanes], c[Lanes], d[Lanes], e[Lanes], f[Lanes], g[Lanes], h[Lanes];
+	for (size_t l = 0; l < Lanes; l++) {
+		a[l] = state[0][l]; b[l] = state[1][l]; c[l] = state[2][l]; d[l] = state[3][l];
+		e[l] = state[4][l]; f[l] = state[5][l]; g[l] = state[6][l]; h[l] = state[7][l];
+	}
+	for (int t = 0; t < 64; t++) {
+		for (size_t l = 0; l < Lanes; l++) {
+			uint32_t t1 = h[l] + (rotr(e[l], 6) ^ rotr(e[l], 11) ^ rotr(e[l], 25)) + ((e[l] & f[l]) ^ (~e[l] & g[l])) + K[t] + w[t][l];
+			uint32_t t2 = (rotr(a[l], 2) ^ rotr(a[l], 13) ^ rotr(a[l], 22)) + ((a[l] & b[l]) ^ (a[l] & c[l]) ^ (b[l] & c[l]));
+			h[l] = g[l]; g[l] = f[l]; f[l] = e[l]; e[l] = d[l] + t1;
+			d[l] = c[l]; c[l] = b[l]; b[l] = a[l]; a[l] = t1 + t2;
+		}
+	}
+	for (size_t l = 0; l < Lanes; l++) {
+		state[0][l] += a[l]; state[1][l] += b[l]; state[2][l] += c[l]; state[3][l] += d[l];
+		state[4][l] += e[l]; state[5][l] += f[l]; state[6][l] += g[l]; state[7][l] += h[l];
+	}
+}
+
+// One block in every lane, w[0..15] holds the message words
+template<size_t Lanes>
+inline void compress(uint32_t (&state)[8][Lanes], uint32_t (&w)[64][Lanes]) {
+	expand(w);
+	rounds(state, w);
+}
+
+// Hashes Lanes messages of Len bytes (33 or 65), in[l] and out[l] are the message and the 32 bytes digest of lane l
+template<size_t Len, size_t Lanes>
+inline void sha256Lanes(const uint8_t* const* in, uint8_t* const* out) {
+	static_assert(Len == 33 || Len == 65, "only pubkey lengths are specialized");
+	uint32_t state[8][Lanes];
+	uint32_t w[64][Lanes];
+	for (int i = 0; i < 8; i++) {
+		for (size_t l = 0; l < Lanes; l++) state[i][l] = IV[i];
+	}
+
+	if constexpr (Len == 65) {
+		// First block: bytes 0..63
+		for (int i = 0; i < 16; i++) {
+			for (size_t l = 0; l < Lanes; l++) w[i][l] = load32(in[l] + 4 * i);
+		}
+		compress(state, w);
+	}
+
+	// Last block: the tail bytes, 0x80, zeros and the bit length
+	constexpr size_t tail = Len % 64; // 33 or 1
+	for (int i = 0; i < 16; i++) {
+		for (size_t l = 0; l < Lanes; l++) w[i][l] = 0;
+	}
+	for (size_t l = 0; l < Lanes; l++) {
+		const uint8_t* p = in[l] + (Len - tail);
+		for (size_t j = 0; j < tail / 4; j++) w[j][l] = load32(p + 4 * j);
+		w[tail / 4][l] = (uint32_t(p[tail - 1]) << 24) | 0x800000;
+	}
+	for (size_t l = 0; l < Lanes; l++) w[15][l] = uint32_t(Len * 8);
+	if constexpr (Len == 65) {
+		expandLast65(w);
+		rounds(state, w);
+	}
+	else {
+		compress(state, w);
+	}
+
+	for (size_t l = 0; l < Lanes; l++) {
+		for (int i = 0; i < 8; i++) store32(out[l] + 4 * i, state[i][l]);
+	}
+}
+
+// State after the sha256(tag) | sha256(tag) block of a tagged hash
+inline void taggedMidstate(uint8_t const* tagHash, uint32_t (&mid)[8]) {
+	uint32_t state[8][1];
+	uint32_t w[64][1];
+	for (int i = 0; i < 8; i++) state[i][0] = IV[i];
+	for (int i = 0; i < 16; i++) w[i][0] = load32(tagHash + 4 * (i % 8));
+	compress(state, w);
+	for (int i = 0; i < 8; i++) mid[i] = state[i][0];
+}
+
+// Tagged hashes of Lanes 32 bytes messages from the tag midstate, a single block each
+template<size_t Lanes>
+inline void taggedSha256Lanes(uint32_t const (&mid)[8], const uint8_t* const* in, uint8_t* const* out) {
+	uint32_t state[8][Lanes];
+	uint32_t w[64][Lanes];
+	for (int i = 0; i < 8; i++) {
+		for (size_t l = 0; l < Lanes; l++) state[i][l] = mid[i];
+	}
+	for (size_t l = 0; l < Lanes; l++) {
+		for (int i = 0; i < 8; i++) w[i][l] = load32(in[l] + 4 * i);
+		w[8][l] = 0x80000000;
+		for (int i = 9; i < 15; i++) w[i][l] = 0;
+		w[15][l] = (64 + 32) * 8;
+	}
+	compress(state, w);
+
+	for (size_t l = 0; l < Lanes; l++) {
+		for (int i = 0; i < 8; i++) store32(out[l] + 4 * i, state[i][l]);
+	}
+}
+
+}
@@ -0,0 +1,57 @@
+﻿#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define WM_HAS_TSC 1
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define WM_HAS_TSC 1
+#endif
+
+// Time stamp counter, reference cycles at the nominal frequency, steady clock nanoseconds where there is none
+inline uint64_t readTicks() {
+#ifdef WM_HAS_TSC
+	return __rdtsc();
+#else
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+// Ticks per second of readTicks, measured once against the steady clock
+inline double ticksPerSecond() {
+#ifdef WM_HAS_TSC
+	static const double rate = [] {
+		auto start = std::chrono::steady_clock::now();
+		uint64_t t0 = readTicks();
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		uint64_t t1 = readTicks();
+		return (t1 - t0) / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}();
+	return rate;
+#else
+	return 1e9;
+#endif
+}
+
+// Stages of a batch, each one a phase over the whole batch
+enum Stage : unsigned { StageKeys, StageEC, StageSha256, StageRipemd160, StageLookup, StageReport, stageCount };
+inline constexpr const char* stageNames[stageCount] = { "keys", "ec", "sha256", "ripemd160", "lookup", "report" };
+
+// Per thread stage times, the counter is read once at the end of each phase of a batch, never per key
+struct StageClock {
+	uint64_t last = 0;
+	uint64_t ticks[stageCount] = {};
+	uint64_t taproot = 0; // Part of the sha256 and ec ticks spent on the P2TR output keys
+
+	void start() { last = readTicks(); }
+
+	void lap(Stage s) {
+		uint64_t now = readTicks();
+		ticks[s] += now - last;
+		last = now;
+	}
+};
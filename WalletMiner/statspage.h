@@ -0,0 +1,370 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+#include "stages.h"
+#include "perf.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <filesystem>
+#endif
+#endif
+
+// Matcher counts of a batch, published with its stage times
+struct BatchCounts {
+	uint64_t lookups = 0; // Index probes, or vanity prefix tests
+	uint64_t candidates = 0; // Probes found in the index, or passing the vanity interval filter
+	uint64_t hits = 0; // Reported
+	uint64_t falsePositives = 0; // Candidates rejected by the full check, the index lookups are exact
+};
+
+// Sum of the counters of some workers
+struct StatsTotals {
+	uint64_t keys = 0;
+	uint64_t batches = 0;
+	uint64_t lookups = 0;
+	uint64_t candidates = 0;
+	uint64_t hits = 0;
+	uint64_t falsePositives = 0;
+	uint64_t ticks[stageCount] = {};
+	uint64_t taprootTicks = 0;
+	uint64_t hw[hwCount] = {};
+	unsigned hwMask = 0; // Bit per HwCounter read by at least one worker
+
+	uint64_t batchTicks() const {
+		uint64_t total = 0;
+		for (auto t : ticks) total += t;
+		return total;
+	}
+
+	StatsTotals& operator+=(StatsTotals const& o) {
+		keys += o.keys;
+		batches += o.batches;
+		lookups += o.lookups;
+		candidates += o.candidates;
+		hits += o.hits;
+		falsePositives += o.falsePositives;
+		for (unsigned s = 0; s < stageCount; s++) ticks[s] += o.ticks[s];
+		taprootTicks += o.taprootTicks;
+		for (unsigned c = 0; c < hwCount; c++) hw[c] += o.hw[c];
+		hwMask |= o.hwMask;
+		return *this;
+	}
+};
+
+// Counters of one worker, on their own cache lines, never reset while it runs
+// Only the worker writes them, once per batch and without locked instructions; readers copy them under a seqlock
+// Stage times are thread times in readTicks units
+struct alignas(64) WorkerStats {
+	std::atomic<uint64_t> seq{ 0 }; // Odd while the worker publishes
+	std::atomic<uint64_t> keys{ 0 };
+	std::atomic<uint64_t> batches{ 0 };
+	std::atomic<uint64_t> lookups{ 0 };
+	std::atomic<uint64_t> candidates{ 0 };
+	std::atomic<uint64_t> hits{ 0 };
+	std::atomic<uint64_t> falsePositives{ 0 };
+	std::atomic<uint64_t> ticks[stageCount] = {};
+	std::atomic<uint64_t> taprootTicks{ 0 };
+	std::atomic<uint64_t> hw[hwCount] = {}; // --perf
+	std::atomic<uint32_t> hwMask{ 0 };
+
+	// Publishes a batch of n keys and restarts its clock and counts, hwDelta is nullptr without counters
+	void add(size_t n, StageClock& clock, BatchCounts& counts, uint64_t const* hwDelta) {
+		write([&]() {
+			bump(keys, n);
+			bump(batches, 1);
+			bump(lookups, counts.lookups);
+			bump(candidates, counts.candidates);
+			bump(hits, counts.hits);
+			bump(falsePositives, counts.falsePositives);
+			for (unsigned s = 0; s < stageCount; s++) bump(ticks[s], clock.ticks[s]);
+			bump(taprootTicks, clock.taproot);
+			for (unsigned c = 0; hwDelta && c < hwCount; c++) bump(hw[c], hwDelta[c]);
+		});
+		clock = StageClock{ clock.last };
+		counts = {};
+	}
+
+	// Before the worker of the slot starts
+	void reset() {
+		write([&]() {
+			for (auto* a : { &keys, &batches, &lookups, &candidates, &hits, &falsePositives, &taprootTicks }) a->store(0, std::memory_order_relaxed);
+			for (auto& a : ticks) a.store(0, std::memory_order_relaxed);
+			for (auto& a : hw) a.store(0, std::memory_order_relaxed);
+		});
+		hwMask = 0;
+	}
+
+	// Consistent copy, retried while the worker is publishing
+	StatsTotals read() const {
+		StatsTotals t;
+		for (;;) {
+			uint64_t s = seq.load(std::memory_order_acquire);
+			if (s & 1) {
+				std::this_thread::yield();
+				continue;
+			}
+			t.keys = keys.load(std::memory_order_relaxed);
+			t.batches = batches.load(std::memory_order_relaxed);
+			t.lookups = lookups.load(std::memory_order_relaxed);
+			t.candidates = candidates.load(std::memory_order_relaxed);
+			t.hits = hits.load(std::memory_order_relaxed);
+			t.falsePositives = falsePositives.load(std::memory_order_relaxed);
+			for (unsigned i = 0; i < stageCount; i++) t.ticks[i] = ticks[i].load(std::memory_order_relaxed);
+			t.taprootTicks = taprootTicks.load(std::memory_order_relaxed);
+			for (unsigned c = 0; c < hwCount; c++) t.hw[c] = hw[c].load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (seq.load(std::memory_order_relaxed) == s) break;
+		}
+		t.hwMask = hwMask.load(std::memory_order_relaxed);
+		return t;
+	}
+
+private:
+	// Single writer: a load and a store instead of a locked add
+	static void bump(std::atomic<uint64_t>& a, uint64_t v) {
+		a.store(a.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+	}
+
+	template<typename Fn>
+	void write(Fn&& fn) {
+		uint64_t s = seq.load(std::memory_order_relaxed);
+		seq.store(s + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		fn();
+		seq.store(s + 2, std::memory_order_release);
+	}
+};
+
+// Layout of the page, bumped on any change of the header or of WorkerStats
+inline constexpr uint32_t statsPageMagic = 0x54534d57; // "WMST"
+inline constexpr uint32_t statsPageVersion = 3;
+
+enum class MinerState : uint32_t { Loading, Running, Done };
+inline constexpr const char* minerStateNames[] = { "loading", "running", "done" };
+
+// Start of the page, the process wide values, written by the main thread
+struct alignas(64) StatsPageHeader {
+	std::atomic<uint32_t> magic; // Stored last, once the page is initialised
+	uint32_t version;
+	uint32_t headerSize;
+	uint32_t slotSize;
+	uint32_t capacity; // WorkerStats slots after the header
+	uint32_t pid;
+	uint64_t startTime; // Unix time in ms
+	double ticksPerSecond;
+	char mode[32];
+	std::atomic<uint32_t> threads; // Slots of the current run
+	std::atomic<uint32_t> state;
+	std::atomic<uint64_t> indexOutputs;
+	std::atomic<uint64_t> indexBytes; // Estimate of the memory held by the index
+	std::atomic<double> vanityProbability; // Per key, 0 without vanity prefixes
+	std::atomic<uint64_t> loaderBytes; // Balance files read so far
+	std::atomic<uint64_t> loaderSize; // Total size of the balance files
+	std::atomic<uint64_t> loaderRows;
+};
+
+// Shared memory page of a miner process: the header, then one WorkerStats slot per thread
+// Named walletminer.<pid>, in /dev/shm on Linux and a named mapping on Windows, so wm-top finds the miners of the host
+// The miner only writes its own memory, reading it costs the readers alone
+class StatsPage {
+public:
+	StatsPage() = default;
+	StatsPage(StatsPage const&) = delete;
+	StatsPage& operator=(StatsPage const&) = delete;
+
+	~StatsPage() {
+		close();
+	}
+
+	static std::string name(uint32_t pid) {
+#ifdef _WIN32
+		return "Local\\walletminer." + std::to_string(pid);
+#else
+		return "/walletminer." + std::to_string(pid);
+#endif
+	}
+
+	static uint32_t currentPid() {
+#ifdef _WIN32
+		return GetCurrentProcessId();
+#else
+		return static_cast<uint32_t>(getpid());
+#endif
+	}
+
+	// Page of this process, empty on success, else why it is on the heap where no reader can see it
+	std::string create(unsigned capacity, std::string const& mode) {
+		close();
+		uint32_t pid = currentPid();
+		size_t size = sizeof(StatsPageHeader) + capacity * sizeof(WorkerStats);
+		std::string error;
+#ifdef _WIN32
+		handle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, static_cast<DWORD>(size), name(pid).c_str());
+		if (handle) {
+			base = MapViewOfFile(handle, FILE_MAP_WRITE, 0, 0, size);
+			if (!base) {
+				CloseHandle(handle);
+				handle = nullptr;
+			}
+		}
+		if (!base) error = "CreateFileMapping failed, error " + std::to_string(GetLastError());
+#else
+		shm_unlink(name(pid).c_str()); // Left by a dead process with the same pid, a reader may still map it
+		int fd = shm_open(name(pid).c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+		if (fd >= 0 && ftruncate(fd, static_cast<off_t>(size)) == 0) {
+			void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if (p != MAP_FAILED) base = p;
+		}
+		if (!base) {
+			error = std::string{ "shm_open: " } + std::strerror(errno);
+			if (fd >= 0) shm_unlink(name(pid).c_str());
+		}
+		if (fd >= 0) ::close(fd);
+#endif
+		if (base) {
+			mapped = size;
+			owner = true;
+		}
+		else {
+			heap.reset(new (std::align_val_t{ alignof(StatsPageHeader) }) std::byte[size]);
+			base = heap.get();
+		}
+
+		auto* h = new (base) StatsPageHeader{};
+		h->version = statsPageVersion;
+		h->headerSize = sizeof(StatsPageHeader);
+		h->slotSize = sizeof(WorkerStats);
+		h->capacity = capacity;
+		h->pid = pid;
+		h->startTime = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+		h->ticksPerSecond = ticksPerSecond();
+		std::strncpy(h->mode, mode.c_str(), sizeof(h->mode) - 1);
+		auto* slot = reinterpret_cast<WorkerStats*>(h + 1);
+		for (unsigned i = 0; i < capacity; i++) new (slot + i) WorkerStats{};
+		h->magic.store(statsPageMagic, std::memory_order_release);
+		return error;
+	}
+
+	// Maps the page of another process read only, false if it is gone, not ready or of another version
+	bool open(uint32_t pid) {
+		close();
+#ifdef _WIN32
+		handle = OpenFileMappingA(FILE_MAP_READ, FALSE, name(pid).c_str());
+		if (!handle) return false;
+		base = MapViewOfFile(handle, FILE_MAP_READ, 0, 0, 0);
+		MEMORY_BASIC_INFORMATION info;
+		if (base && VirtualQuery(base, &info, sizeof(info))) mapped = info.RegionSize;
+#else
+		int fd = shm_open(name(pid).c_str(), O_RDONLY, 0);
+		if (fd < 0) return false;
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(StatsPageHeader))) {
+			void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+			if (p != MAP_FAILED) {
+				base = p;
+				mapped = static_cast<size_t>(st.st_size);
+			}
+		}
+		::close(fd);
+#endif
+		auto const* h = header();
+		if (!h || mapped < sizeof(StatsPageHeader) || h->magic.load(std::memory_order_acquire) != statsPageMagic || h->version != statsPageVersion
+			|| h->headerSize != sizeof(StatsPageHeader) || h->slotSize != sizeof(WorkerStats) || mapped < sizeof(StatsPageHeader) + h->capacity * sizeof(WorkerStats)) {
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close() {
+#ifdef _WIN32
+		if (mapped) UnmapViewOfFile(base);
+		if (handle) CloseHandle(handle);
+		handle = nullptr;
+#else
+		if (mapped) munmap(base, mapped);
+		if (owner) shm_unlink(name(currentPid()).c_str());
+#endif
+		heap.reset();
+		base = nullptr;
+		mapped = 0;
+		owner = false;
+	}
+
+	StatsPageHeader* header() const { return static_cast<StatsPageHeader*>(base); }
+	WorkerStats* slots() const { return base ? reinterpret_cast<WorkerStats*>(header() + 1) : nullptr; }
+	unsigned capacity() const { return base ? header()->capacity : 0; }
+
+	// Sum of the slots of the current run
+	StatsTotals totals() const {
+		StatsTotals t;
+		for (unsigned i = 0; base && i < std::min(header()->threads.load(), header()->capacity); i++) t += slots()[i].read();
+		return t;
+	}
+
+	// Pids with a page, only Linux can list them, elsewhere the pids are given to wm-top
+	static std::vector<uint32_t> list() {
+		std::vector<uint32_t> pids;
+#ifdef __linux__
+		std::error_code ec;
+		for (auto const& entry : std::filesystem::directory_iterator{ "/dev/shm", ec }) {
+			auto file = entry.path().filename().string();
+			if (file.rfind("walletminer.", 0) == 0 && file.size() > 12 && file.find_first_not_of("0123456789", 12) == std::string::npos) {
+				pids.push_back(static_cast<uint32_t>(std::stoul(file.substr(12))));
+			}
+		}
+#endif
+		return pids;
+	}
+
+	static bool alive(uint32_t pid) {
+#ifdef _WIN32
+		HANDLE p = OpenProcess(SYNCHRONIZE, FALSE, pid);
+		if (!p) return false;
+		bool running = WaitForSingleObject(p, 0) == WAIT_TIMEOUT;
+		CloseHandle(p);
+		return running;
+#else
+		return kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM;
+#endif
+	}
+
+	// Page of a process that died without removing it, a named mapping goes with its last handle on Windows
+	static void remove(uint32_t pid) {
+#ifndef _WIN32
+		shm_unlink(name(pid).c_str());
+#else
+		(void)pid;
+#endif
+	}
+
+private:
+	struct AlignedDelete {
+		void operator()(std::byte* p) const { ::operator delete[](p, std::align_val_t{ alignof(StatsPageHeader) }); }
+	};
+
+	void* base = nullptr;
+	size_t mapped = 0; // Bytes mapped, 0 on the heap
+	bool owner = false;
+	std::unique_ptr<std::byte[], AlignedDelete> heap;
+#ifdef _WIN32
+	HANDLE handle = nullptr;
+#endif
+};
@@ -0,0 +1,205 @@
+﻿// wm-top: live view of the miners running on this host, read from their shared stats pages
+// Built from the same sources, WalletMiner.cpp is included without its main()
+#define WALLETMINER_NO_MAIN
+#include "WalletMiner.cpp"
+
+namespace top {
+
+struct Config {
+	double interval = 1; // Seconds between two refreshes
+	bool once = false; // Print one refresh and exit
+	bool perThread = false;
+	std::vector<uint32_t> pids; // Miners to show, every page of the host when empty
+};
+
+// One reading of the page of a miner
+struct Sample {
+	uint32_t pid = 0;
+	std::string mode;
+	MinerState state = MinerState::Loading;
+	uint64_t startTime = 0; // Unix time in ms
+	uint64_t indexOutputs = 0;
+	uint64_t indexBytes = 0;
+	double vanityProbability = 0;
+	uint64_t loaderBytes = 0;
+	uint64_t loaderSize = 0;
+	uint64_t loaderRows = 0;
+	StatsTotals totals;
+	std::vector<StatsTotals> threads;
+	steady_clock::time_point at;
+};
+
+std::optional<Sample> readPage(uint32_t pid) {
+	StatsPage page;
+	if (!page.open(pid)) return std::nullopt;
+	auto const& h = *page.header();
+	Sample s;
+	s.pid = pid;
+	s.mode = std::string{ h.mode, strnlen(h.mode, sizeof(h.mode)) };
+	s.state = static_cast<MinerState>(std::min<uint32_t>(h.state, static_cast<uint32_t>(MinerState::Done)));
+	s.startTime = h.startTime;
+	s.indexOutputs = h.indexOutputs;
+	s.indexBytes = h.indexBytes;
+	s.vanityProbability = h.vanityProbability;
+	s.loaderBytes = h.loaderBytes;
+	s.loaderSize = h.loaderSize;
+	s.loaderRows = h.loaderRows;
+	for (unsigned i = 0; i < std::min(h.threads.load(), h.capacity); i++) {
+		s.threads.push_back(page.slots()[i].read());
+		s.totals += s.threads.back();
+	}
+	s.at = steady_clock::now();
+	return s;
+}
+
+// Pages of the live miners, the pages left by dead ones are removed when they were listed rather than given
+std::vector<Sample> readPages(Config const& cfg) {
+	std::vector<Sample> samples;
+	auto pids = cfg.pids.empty() ? StatsPage::list() : cfg.pids;
+	std::sort(pids.begin(), pids.end());
+	for (uint32_t pid : pids) {
+		if (!StatsPage::alive(pid)) {
+			if (cfg.pids.empty()) StatsPage::remove(pid);
+			continue;
+		}
+		if (auto s = readPage(pid)) samples.push_back(std::move(*s));
+	}
+	return samples;
+}
+
+// 950, 12.3k, 4.56M
+std::string formatCount(double v) {
+	static constexpr const char* units[] = { "", "k", "M", "G", "T" };
+	unsigned u = 0;
+	while (v >= 1000 && u + 1 < std::size(units)) {
+		v /= 1000;
+		u++;
+	}
+	std::ostringstream os;
+	os << std::fixed << std::setprecision(u && v < 100 ? (v < 10 ? 2 : 1) : 0) << v << units[u];
+	return os.str();
+}
+
+double rate(uint64_t now, uint64_t before, double seconds) {
+	return seconds > 0 && now >= before ? (now - before) / seconds : 0;
+}
+
+// Index hit rate of the lookups, and the candidates a filter let through for nothing
+std::string filterSummary(StatsTotals const& t) {
+	std::ostringstream os;
+	os << std::setprecision(3) << "lookups " << formatCount(double(t.lookups)) << ", pass " << (t.lookups ? 100.0 * t.candidates / t.lookups : 0) << "%";
+	if (t.falsePositives) os << ", false positives " << t.falsePositives;
+	return os.str();
+}
+
+void print(std::vector<Sample> const& samples, std::map<uint32_t, Sample> const& previous, Config const& cfg) {
+	uint64_t nowMs = static_cast<uint64_t>(duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count());
+	StatsTotals all;
+	double allSpeed = 0;
+	std::ostringstream os;
+	for (auto const& s : samples) {
+		auto prev = previous.find(s.pid);
+		double seconds = prev != previous.end() ? duration<double>(s.at - prev->second.at).count() : 0;
+		double speed = prev != previous.end() ? rate(s.totals.keys, prev->second.totals.keys, seconds) : 0;
+		all += s.totals;
+		allSpeed += speed;
+
+		os << std::left << std::setw(8) << s.pid << std::setw(14) << s.mode << std::setw(9) << minerStateNames[static_cast<uint32_t>(s.state)]
+			<< std::setw(4) << s.threads.size() << std::setw(8) << formatDuration((nowMs - std::min(nowMs, s.startTime)) / 1000.0)
+			<< std::right << std::setw(10) << formatCount(speed) << " keys/s" << std::setw(10) << formatCount(double(s.totals.keys)) << " keys"
+			<< std::setw(6) << s.totals.hits << " hits" << std::endl;
+		if (s.state == MinerState::Loading && s.loaderSize) {
+			os << "        loaded " << 100 * s.loaderBytes / s.loaderSize << "% of the balance files, " << formatCount(double(s.loaderRows)) << " rows" << std::endl;
+		}
+		if (s.indexOutputs) os << "        index " << formatCount(double(s.indexOutputs)) << " outputs in " << formatCount(double(s.indexBytes)) << "B, " << filterSummary(s.totals) << std::endl;
+		else if (s.vanityProbability > 0) {
+			double keysLeft = std::max(0.0, std::log(2) / s.vanityProbability - s.totals.keys);
+			os << "        " << std::setprecision(3) << 100 * -std::expm1(-(s.totals.keys * s.vanityProbability)) << "% chance so far, 50% in "
+				<< (speed > 0 ? formatDuration(keysLeft / speed) : "-") << ", " << filterSummary(s.totals) << std::endl;
+		}
+		if (s.totals.batches) os << "        " << stageBreakdown(s.totals) << std::endl;
+		if (auto hw = hwBreakdown(s.totals); !hw.empty()) os << "        " << hw << std::endl;
+		if (cfg.perThread) {
+			for (size_t i = 0; i < s.threads.size(); i++) {
+				bool known = prev != previous.end() && i < prev->second.threads.size();
+				os << "        thread " << std::left << std::setw(4) << i << std::right << std::setw(10)
+					<< formatCount(known ? rate(s.threads[i].keys, prev->second.threads[i].keys, seconds) : 0) << " keys/s" << std::endl;
+			}
+		}
+	}
+	if (samples.size() > 1) {
+		os << std::left << std::setw(8) << "total" << std::setw(35) << std::to_string(samples.size()) + " miners" << std::right << std::setw(10) << formatCount(allSpeed) << " keys/s" << std::setw(10) << formatCount(double(all.keys)) << " keys"
+			<< std::setw(6) << all.hits << " hits" << std::endl;
+		if (all.batches) os << "        " << stageBreakdown(all) << std::endl;
+	}
+	if (samples.empty()) os << "No miner running on this host" << std::endl;
+
+	if (!cfg.once) std::cout << "\x1b[H\x1b[2J"; // Home and clear
+	std::cout << std::left << std::setw(8) << "PID" << std::setw(14) << "MODE" << std::setw(9) << "STATE" << std::setw(4) << "THR" << std::setw(8) << "UPTIME"
+		<< std::right << std::setw(17) << "SPEED" << std::setw(15) << "TESTED" << std::setw(11) << "FOUND" << std::endl << os.str() << std::flush;
+}
+
+void run(Config const& cfg) {
+	std::map<uint32_t, Sample> previous;
+	auto wait = duration_cast<steady_clock::duration>(duration<double>(cfg.interval));
+	if (cfg.once) {
+		// The rates need two readings
+		for (auto& s : readPages(cfg)) previous[s.pid] = std::move(s);
+		std::this_thread::sleep_for(wait);
+	}
+	while (!stopRequested) {
+		auto samples = readPages(cfg);
+		print(samples, previous, cfg);
+		if (cfg.once) break;
+		previous.clear();
+		for (auto& s : samples) previous[s.pid] = std::move(s);
+		std::this_thread::sleep_for(wait);
+	}
+}
+
+void printUsage() {
+	std::cout << "Usage wm-top [options] [pid...]" << std::endl;
+	std::cout << "  Shows the miners of this host, or the given processes (needed on Windows)" << std::endl;
+	std::cout << "  --interval <s>      Seconds between refreshes, default 1" << std::endl;
+	std::cout << "  --once              Print one refresh and exit" << std::endl;
+	std::cout << "  --threads           Also show the speed of each worker thread" << std::endl;
+}
+
+Config parseOptions(int argc, char** argv) {
+	Config cfg;
+	for (int i = 1; i < argc; i++) {
+		std::string arg{ argv[i] };
+		auto value = [&]() -> std::string {
+			if (i + 1 >= argc) throw std::runtime_error{ "Missing value for " + arg };
+			return argv[++i];
+		};
+		if (arg == "--interval") {
+			cfg.interval = std::stod(value());
+			if (!(cfg.interval > 0)) throw std::runtime_error{ "Invalid interval" };
+		}
+		else if (arg == "--once") cfg.once = true;
+		else if (arg == "--threads") cfg.perThread = true;
+		else if (arg.starts_with("--")) throw std::runtime_error{ "Unknown option " + arg };
+		else cfg.pids.push_back(static_cast<uint32_t>(std::stoul(arg)));
+	}
+	return cfg;
+}
+
+}
+
+int main(int argc, char** argv) {
+	top::Config cfg;
+	try {
+		cfg = top::parseOptions(argc, argv);
+	}
+	catch (const std::exception& e) {
+		std::cout << e.what() << std::endl;
+		top::printUsage();
+		return 1;
+	}
+
+	std::signal(SIGINT, onStopSignal);
+	std::signal(SIGTERM, onStopSignal);
+	top::run(cfg);
+	return 0;
+}
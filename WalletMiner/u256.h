@@ -0,0 +1,142 @@
+﻿#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+// 256 bits unsigned integer stored big endian, same layout as a private key
+using u256 = std::array<uint8_t, 32>;
+
+// <0, 0 or >0 like memcmp
+inline int u256Cmp(u256 const& a, u256 const& b) {
+	return std::memcmp(a.data(), b.data(), 32);
+}
+
+inline bool u256IsZero(u256 const& a) {
+	for (uint8_t c : a) {
+		if (c) return false;
+	}
+	return true;
+}
+
+inline u256 u256FromU64(uint64_t v) {
+	u256 r{};
+	for (int i = 31; i >= 24; i--) {
+		r[i] = static_cast<uint8_t>(v & 0xFF);
+		v >>= 8;
+	}
+	return r;
+}
+
+// Low 64 bits, sets *overflow if the value does not fit
+inline uint64_t u256ToU64(u256 const& a, bool* overflow = nullptr) {
+	uint64_t v = 0;
+	for (int i = 24; i < 32; i++) {
+		v = (v << 8) | a[i];
+	}
+	if (overflow) {
+		*overflow = false;
+		for (int i = 0; i < 24; i++) {
+			if (a[i]) *overflow = true;
+		}
+	}
+	return v;
+}
+
+// Approximation used for progress and ETA display
+inline double u256ToDouble(u256 const& a) {
+	double v = 0;
+	for (uint8_t c : a) {
+		v = v * 256.0 + c;
+	}
+	return v;
+}
+
+// a + b mod 2^256
+inline u256 u256Add(u256 const& a, u256 const& b) {
+	u256 r{};
+	unsigned carry = 0;
+	for (int i = 31; i >= 0; i--) {
+		carry += static_cast<unsigned>(a[i]) + b[i];
+		r[i] = static_cast<uint8_t>(carry & 0xFF);
+		carry >>= 8;
+	}
+	return r;
+}
+
+// a - b mod 2^256
+inline u256 u256Sub(u256 const& a, u256 const& b) {
+	u256 r{};
+	int borrow = 0;
+	for (int i = 31; i >= 0; i--) {
+		int d = static_cast<int>(a[i]) - b[i] - borrow;
+		borrow = d < 0;
+		r[i] = static_cast<uint8_t>(d + (borrow << 8));
+	}
+	return r;
+}
+
+inline u256 u256AddU64(u256 const& a, uint64_t v) {
+	return u256Add(a, u256FromU64(v));
+}
+
+// a * m mod 2^256
+inline u256 u256MulU32(u256 const& a, uint32_t m) {
+	u256 r{};
+	uint64_t carry = 0;
+	for (int i = 31; i >= 0; i--) {
+		carry += static_cast<uint64_t>(a[i]) * m;
+		r[i] = static_cast<uint8_t>(carry & 0xFF);
+		carry >>= 8;
+	}
+	return r;
+}
+
+// a / d, remainder in *rem
+inline u256 u256DivU32(u256 const& a, uint32_t d, uint32_t* rem = nullptr) {
+	if (d == 0) throw std::runtime_error{ "Division by zero" };
+	u256 q{};
+	uint64_t r = 0;
+	for (int i = 0; i < 32; i++) {
+		r = (r << 8) | a[i];
+		q[i] = static_cast<uint8_t>(r / d);
+		r %= d;
+	}
+	if (rem) *rem = static_cast<uint32_t>(r);
+	return q;
+}
+
+// Accepts up to 64 hex digits with an optional 0x prefix
+inline u256 u256FromHex(std::string str) {
+	if (str.starts_with("0x") || str.starts_with("0X")) {
+		str = str.substr(2);
+	}
+	if (str.empty() || str.size() > 64) {
+		throw std::runtime_error{ "Invalid 256 bits hex value: " + str };
+	}
+	u256 r{};
+	int pos = 63;
+	for (auto it = str.rbegin(); it != str.rend(); ++it, pos--) {
+		char c = *it;
+		int v;
+		if (c >= '0' && c <= '9') v = c - '0';
+		else if (c >= 'a' && c <= 'f') v = c - 'a' + 10;
+		else if (c >= 'A' && c <= 'F') v = c - 'A' + 10;
+		else throw std::runtime_error{ "Invalid 256 bits hex value: " + str };
+		r[pos / 2] |= static_cast<uint8_t>(pos % 2 ? v : v << 4);
+	}
+	return r;
+}
+
+// 64 chars lowercase hex
+inline std::string u256ToHex(u256 const& a) {
+	static const char* digits = "0123456789abcdef";
+	std::string s(64, '0');
+	for (int i = 0; i < 32; i++) {
+		s[i * 2] = digits[a[i] >> 4];
+		s[i * 2 + 1] = digits[a[i] & 0xF];
+	}
+	return s;
+}
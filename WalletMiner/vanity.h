@@ -0,0 +1,331 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "u256.h"
+#include "bech32.h"
+
+using Hash160 = std::array<uint8_t, 20>;
+
+// Base58 P2PKH address prefixes turned into hash160 intervals once at startup
+// A candidate key is then matched with a 20 bytes comparison, no base58 encoding per key
+//
+// The address is base58(N), N = 0x00 | hash160 | checksum read as a 200 bits integer,
+// with one '1' per leading zero byte. A prefix is a set of N intervals, one per address length,
+// so hash160 = N >> 32 falls in the same intervals rounded to whole hash160 values.
+// The rounding lets through at most two wrong hash160 per interval, matchAddress() tells them apart.
+//
+// Any number of prefixes, and their case variants, end up in one sorted array of disjoint intervals.
+// A table on the 16 leading bits narrows the search to the few intervals of that bucket,
+// which are then searched without branches, so the cost per key stays flat from 1 to 100k prefixes.
+//
+// Bech32 P2WPKH prefixes (bc1q...) spell the hash160 5 bits per character with no checksum in the way,
+// each one is an exact (mask, value) test on the leading bits, run on whole batches by matchSegwit().
+class VanityPatterns {
+public:
+	// Case insensitive prefixes add every spelling made of valid base58 characters, bech32 ignores case anyway
+	// Throws on a prefix that no P2PKH or P2WPKH address can start with, duplicates are ignored
+	void add(std::string const& prefix, bool ignoreCase = false) {
+		if (prefix.size() >= 3 && (prefix.compare(0, 3, "bc1") == 0 || prefix.compare(0, 3, "BC1") == 0)) {
+			addSegwit(prefix);
+			return;
+		}
+		if (prefix.empty() || prefix[0] != '1') throw std::runtime_error{ "Vanity prefix must start with 1 or bc1q: " + prefix };
+		if (prefix.size() > 34) throw std::runtime_error{ "Vanity prefix too long: " + prefix };
+		std::string canonical = prefix;
+		if (ignoreCase) {
+			for (char& c : canonical) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+		}
+		if (!added.insert(canonical).second) return;
+
+		// Characters allowed at each position
+		std::vector<std::string> choices;
+		size_t variants = 1;
+		for (char c : prefix) {
+			std::string options;
+			if (digit(c) >= 0) options += c;
+			if (ignoreCase) {
+				char other = std::isupper(static_cast<unsigned char>(c)) ? static_cast<char>(std::tolower(static_cast<unsigned char>(c))) : static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+				if (other != c && digit(other) >= 0) options += other;
+			}
+			if (options.empty()) throw std::runtime_error{ "Invalid base58 character in vanity prefix: " + prefix };
+			variants *= options.size();
+			if (variants > maxVariants) throw std::runtime_error{ "Too many case variants for vanity prefix: " + prefix };
+			choices.push_back(options);
+		}
+
+		uint32_t index = static_cast<uint32_t>(prefixes.size());
+		prefixes.push_back(prefix);
+		std::string spelling(prefix.size(), ' ');
+		for (size_t v = 0; v < variants; v++) {
+			size_t rest = v;
+			for (size_t i = 0; i < prefix.size(); i++) {
+				spelling[i] = choices[i][rest % choices[i].size()];
+				rest /= choices[i].size();
+			}
+			addSpelling(spelling, index);
+		}
+	}
+
+	// Sorts and merges the intervals, call once every prefix is added
+	void finalize() {
+		merge(intervals);
+		merge(segwitIntervals);
+		lows.clear();
+		highs.clear();
+		for (auto const& i : intervals) {
+			lows.push_back(toKey(i.lo));
+			highs.push_back(toKey(i.hi));
+		}
+		// buckets[b] = intervals starting before bucket b
+		buckets.assign(bucketCount + 1, 0);
+		size_t next = 0;
+		for (size_t b = 0; b <= bucketCount; b++) {
+			while (next < intervals.size() && bucketOf(intervals[next].lo) < b) next++;
+			buckets[b] = static_cast<uint32_t>(next);
+		}
+
+		std::sort(spellings.begin(), spellings.end());
+		spellings.erase(std::unique(spellings.begin(), spellings.end(), [](auto const& a, auto const& b) { return a.first == b.first; }), spellings.end());
+		lengths.clear();
+		for (auto const& s : spellings) lengths.push_back(s.first.size());
+		std::sort(lengths.begin(), lengths.end());
+		lengths.erase(std::unique(lengths.begin(), lengths.end()), lengths.end());
+	}
+
+	bool empty() const { return prefixes.empty(); }
+
+	// True when the hash160 may give one of the prefixes
+	bool contains(Hash160 const& h) const {
+		size_t b = bucketOf(h);
+		if (buckets.empty() || buckets[b + 1] == 0) return false; // Nothing starts at or before this bucket
+		// The interval running into the bucket, then the ones starting in it
+		size_t first = buckets[b] ? buckets[b] - 1 : 0;
+		Key k = toKey(h);
+		// Last of them starting at or before k, or the first one, the loop length only depends on the count
+		Key const* base = lows.data() + first;
+		for (size_t n = buckets[b + 1] - first; n > 1; n -= n / 2) {
+			base = lessEqual(base[n / 2], k) ? base + n / 2 : base;
+		}
+		return lessEqual(*base, k) & lessEqual(k, highs[base - lows.data()]);
+	}
+
+	bool hasSegwit() const { return !segwitMasks.empty(); }
+
+	// out[i] = 1 when the P2WPKH address of h[i] starts with one of the bc1q prefixes, exact
+	// Branch free mask and compare over plain arrays, vectorised by the compiler
+	void matchSegwit(Hash160 const* h, size_t n, uint8_t* out) const {
+		constexpr size_t lanes = 64;
+		for (size_t start = 0; start < n; start += lanes) {
+			size_t count = std::min(lanes, n - start);
+			uint64_t hi[lanes], mid[lanes];
+			uint32_t lo[lanes];
+			uint8_t hit[lanes] = {};
+			for (size_t i = 0; i < count; i++) {
+				Key k = toKey(h[start + i]);
+				hi[i] = k.hi;
+				mid[i] = k.mid;
+				lo[i] = k.lo;
+			}
+			for (size_t p = 0; p < segwitMasks.size(); p++) {
+				Key m = segwitMasks[p];
+				Key v = segwitValues[p];
+				for (size_t i = 0; i < count; i++) {
+					hit[i] |= static_cast<uint8_t>((((hi[i] & m.hi) ^ v.hi) | ((mid[i] & m.mid) ^ v.mid) | ((lo[i] & m.lo) ^ v.lo)) == 0);
+				}
+			}
+			std::copy_n(hit, count, out + start);
+		}
+	}
+
+	// Longest prefix, as given to add(), the address starts with, nullptr if none
+	std::string const* matchAddress(std::string_view a) const {
+		for (auto l = lengths.rbegin(); l != lengths.rend(); ++l) {
+			size_t len = *l;
+			if (len > a.size()) continue;
+			auto head = a.substr(0, len);
+			auto it = std::lower_bound(spellings.begin(), spellings.end(), head, [](auto const& s, std::string_view v) { return s.first < v; });
+			if (it != spellings.end() && it->first == head) return &prefixes[it->second];
+		}
+		return nullptr;
+	}
+
+	// Chance for one random key to match any of the prefixes
+	double probability() const {
+		double width = 0;
+		for (auto const* list : { &intervals, &segwitIntervals }) {
+			for (auto const& i : *list) {
+				width += u256ToDouble(u256AddU64(u256Sub(widen(i.hi), widen(i.lo)), 1));
+			}
+		}
+		return std::ldexp(width, -160);
+	}
+
+	std::vector<std::string> const& patterns() const { return prefixes; }
+
+	size_t intervalCount() const { return intervals.size(); }
+
+private:
+	static constexpr size_t maxVariants = 1 << 16;
+	static constexpr size_t bucketCount = 1 << 16;
+
+	static size_t bucketOf(Hash160 const& h) { return (static_cast<size_t>(h[0]) << 8) | h[1]; }
+
+	struct Interval {
+		Hash160 lo;
+		Hash160 hi;
+	};
+
+	// Hash160 as integers, compared without branches
+	struct Key {
+		uint64_t hi;
+		uint64_t mid;
+		uint32_t lo;
+	};
+
+	static Key toKey(Hash160 const& h) {
+		Key k{ 0, 0, 0 };
+		for (int i = 0; i < 8; i++) k.hi = (k.hi << 8) | h[i];
+		for (int i = 8; i < 16; i++) k.mid = (k.mid << 8) | h[i];
+		for (int i = 16; i < 20; i++) k.lo = (k.lo << 8) | h[i];
+		return k;
+	}
+
+	static bool lessEqual(Key const& a, Key const& b) {
+		return (a.hi < b.hi) | ((a.hi == b.hi) & ((a.mid < b.mid) | ((a.mid == b.mid) & (a.lo <= b.lo))));
+	}
+
+	static int digit(char c) {
+		static constexpr char alphabet[] = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+		const char* p = std::strchr(alphabet, c);
+		return c && p ? static_cast<int>(p - alphabet) : -1;
+	}
+
+	// 256^k, k < 32
+	static u256 pow256(size_t k) {
+		u256 r{};
+		r[31 - k] = 1;
+		return r;
+	}
+
+	// N < 2^192 sits in the low 25 bytes, the hash160 follows the version byte
+	static Hash160 toHash160(u256 const& n) {
+		Hash160 h;
+		std::copy_n(n.begin() + 8, 20, h.begin());
+		return h;
+	}
+
+	static u256 widen(Hash160 const& h) {
+		u256 r{};
+		std::copy(h.begin(), h.end(), r.begin() + 12);
+		return r;
+	}
+
+	// h + 1, wraps to zero after the last value which never starts an interval
+	static Hash160 successor(Hash160 h) {
+		for (int i = 19; i >= 0 && ++h[i] == 0; i--) {}
+		return h;
+	}
+
+	// Sorts, then merges overlapping and adjacent intervals
+	static void merge(std::vector<Interval>& list) {
+		std::sort(list.begin(), list.end(), [](Interval const& a, Interval const& b) { return a.lo < b.lo; });
+		std::vector<Interval> merged;
+		for (auto const& i : list) {
+			if (!merged.empty() && (i.lo <= merged.back().hi || i.lo == successor(merged.back().hi))) {
+				merged.back().hi = std::max(merged.back().hi, i.hi);
+			}
+			else {
+				merged.push_back(i);
+			}
+		}
+		list = std::move(merged);
+	}
+
+	// bc1q + up to the 32 characters spelling the hash160, the 6 checksum characters cannot be chosen
+	void addSegwit(std::string const& prefix) {
+		std::string p = prefix;
+		for (char& c : p) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+		if (p.compare(0, 4, "bc1q") != 0) throw std::runtime_error{ "Only bc1q (P2WPKH) bech32 prefixes are supported: " + prefix };
+		if (p.size() > 4 + 32) throw std::runtime_error{ "Vanity prefix too long: " + prefix };
+		if (!added.insert(p).second) return;
+
+		Hash160 mask{}, value{};
+		for (size_t i = 4; i < p.size(); i++) {
+			int v = bech32Value(p[i]);
+			if (v < 0) throw std::runtime_error{ "Invalid bech32 character in vanity prefix: " + prefix };
+			for (int b = 0; b < 5; b++) {
+				size_t bit = (i - 4) * 5 + b;
+				uint8_t flag = static_cast<uint8_t>(0x80 >> (bit % 8));
+				mask[bit / 8] |= flag;
+				if ((v >> (4 - b)) & 1) value[bit / 8] |= flag;
+			}
+		}
+		Hash160 top = value;
+		for (size_t i = 0; i < 20; i++) top[i] |= static_cast<uint8_t>(~mask[i]);
+		segwitMasks.push_back(toKey(mask));
+		segwitValues.push_back(toKey(value));
+		segwitIntervals.push_back({ value, top });
+
+		spellings.emplace_back(p, static_cast<uint32_t>(prefixes.size()));
+		prefixes.push_back(p);
+	}
+
+	// One exact spelling, made of valid characters and starting with '1'
+	void addSpelling(std::string const& prefix, uint32_t index) {
+		u256 value{};
+		size_t ones = 0;
+		while (ones < prefix.size() && prefix[ones] == '1') ones++;
+		if (ones > 21) throw std::runtime_error{ "Vanity prefix too long: " + prefix };
+		for (size_t i = ones; i < prefix.size(); i++) {
+			value = u256AddU64(u256MulU32(value, 58), static_cast<uint64_t>(digit(prefix[i])));
+		}
+		size_t digits = prefix.size() - ones;
+
+		// Exactly `ones` leading zero bytes, unless the prefix is only made of '1'
+		u256 high = u256Sub(pow256(25 - ones), u256FromU64(1));
+		if (digits == 0) {
+			addN(u256{}, high);
+		}
+		else {
+			u256 low = pow256(24 - ones);
+			u256 lo = value;
+			u256 hi = u256AddU64(value, 1);
+			for (size_t length = digits; length <= 35; length++) {
+				if (u256Cmp(lo, high) > 0) break;
+				u256 top = u256Sub(hi, u256FromU64(1));
+				if (u256Cmp(top, low) >= 0) {
+					addN(u256Cmp(lo, low) > 0 ? lo : low, u256Cmp(top, high) < 0 ? top : high);
+				}
+				lo = u256MulU32(lo, 58);
+				hi = u256MulU32(hi, 58);
+			}
+		}
+		spellings.emplace_back(prefix, index);
+	}
+
+	void addN(u256 const& lo, u256 const& hi) {
+		intervals.push_back({ toHash160(lo), toHash160(hi) });
+	}
+
+	std::vector<std::string> prefixes; // As given, reported on a match
+	std::set<std::string> added; // Prefixes already added, lower case when added ignoring case
+	std::vector<std::pair<std::string, uint32_t>> spellings; // Exact spelling, index of its prefix
+	std::vector<size_t> lengths; // Distinct spelling lengths
+	std::vector<Interval> intervals;
+	std::vector<Key> lows; // Interval bounds, searched on their own
+	std::vector<Key> highs;
+	std::vector<uint32_t> buckets; // bucketCount + 1 entries
+	std::vector<Key> segwitMasks; // bc1q prefixes, hash160 & mask == value
+	std::vector<Key> segwitValues;
+	std::vector<Interval> segwitIntervals; // Same prefixes as ranges, for the probability
+};
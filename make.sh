@@ -1,4 +1,9 @@
 #/bin/bash
 
-g++ -I"./third-party/openssl/include" -I"./third-party/secp256k1/include" -L"/usr/lib/x86_64-linux-gnu/" -pthread --std="c++20" "./WalletMiner/WalletMiner.cpp" -lsecp256k1 -lcrypto -lssl -o ./WMiner 
+g++ -O2 -I"./third-party/openssl/include" -I"./third-party/secp256k1/include" -L"/usr/lib/x86_64-linux-gnu/" -pthread --std="c++20" "./WalletMiner/WalletMiner.cpp" -lsecp256k1 -lcrypto -lssl -lrt -o ./WMiner 
 
+g++ -O2 -I"./third-party/openssl/include" -I"./third-party/secp256k1/include" -L"/usr/lib/x86_64-linux-gnu/" -pthread --std="c++20" "./WalletMiner/bench.cpp" -lsecp256k1 -lcrypto -lssl -lrt -o ./wm-bench 
+
+g++ -O2 -I"./third-party/openssl/include" -I"./third-party/secp256k1/include" -L"/usr/lib/x86_64-linux-gnu/" -pthread --std="c++20" "./WalletMiner/gen.cpp" -lsecp256k1 -lcrypto -lssl -lrt -o ./wm-gen 
+
+g++ -O2 -I"./third-party/openssl/include" -I"./third-party/secp256k1/include" -L"/usr/lib/x86_64-linux-gnu/" -pthread --std="c++20" "./WalletMiner/top.cpp" -lsecp256k1 -lcrypto -lssl -lrt -o ./wm-top 